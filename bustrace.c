@@ -0,0 +1,220 @@
+/*
+
+  Catalyst PCIBX32 PCI Extender control utility
+
+  Copyright (c) 2006-2009 Michael Buesch <mb@bu3sch.de>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Steet, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+
+*/
+
+#include "bustrace.h"
+#include "pcibx_device.h"
+#include "utils.h"
+
+#include <string.h>
+#include <errno.h>
+
+
+struct bustrace * bustrace_create(const char *file)
+{
+	struct bustrace *t;
+
+	t = calloc(1, sizeof(*t));
+	if (!t) {
+		prerror("Out of memory\n");
+		return NULL;
+	}
+	t->f = fopen(file, "wb");
+	if (!t->f) {
+		prerror("Could not create bus trace %s: %s\n",
+			file, strerror(errno));
+		free(t);
+		return NULL;
+	}
+	setvbuf(t->f, NULL, _IOFBF, 65536);
+	fwrite(BUSTRACE_MAGIC, 8, 1, t->f);
+
+	return t;
+}
+
+void bustrace_close(struct bustrace *t)
+{
+	if (!t)
+		return;
+	if (fclose(t->f))
+		prerror("Could not write the bus trace: %s\n", strerror(errno));
+	free(t);
+}
+
+void bustrace_log(struct bustrace *t, enum bustrace_op op,
+		  uint8_t mask, uint8_t value)
+{
+	struct bustrace_record r;
+	uint64_t now, delta;
+
+	now = monotonic_nsec();
+	delta = t->last ? (now - t->last) / 1000 : 0;
+	if (delta > UINT32_MAX)
+		delta = UINT32_MAX;
+	t->last = now;
+
+	r.delta = delta;
+	r.op = op;
+	r.mask = mask;
+	r.value = value;
+	r.reserved = 0;
+	fwrite(&r, sizeof(r), 1, t->f);
+	t->nr_records++;
+}
+
+
+/*
+ * Replay backend
+ */
+
+struct replay {
+	FILE *f;
+	const char *file;
+	unsigned long nr_records;
+	unsigned long mismatches;
+	int eof;
+};
+
+static int replay_next(struct pcibx_device *dev,
+		       struct bustrace_record *r)
+{
+	struct replay *rp = dev->backend_priv;
+
+	if (rp->eof)
+		return -1;
+	if (fread(r, sizeof(*r), 1, rp->f) != 1) {
+		prerror("Bus trace %s exhausted after %lu records\n",
+			rp->file, rp->nr_records);
+		rp->eof = 1;
+		return -1;
+	}
+	rp->nr_records++;
+
+	return 0;
+}
+
+static void replay_mismatch(struct pcibx_device *dev,
+			    const struct bustrace_record *r,
+			    enum bustrace_op op,
+			    uint8_t mask, uint8_t value)
+{
+	struct replay *rp = dev->backend_priv;
+
+	if (rp->mismatches++ == 0) {
+		prerror("Bus trace %s diverges at record %lu: "
+			"expected op %u mask 0x%02X value 0x%02X, "
+			"got op %u mask 0x%02X value 0x%02X\n",
+			rp->file, rp->nr_records,
+			r->op, r->mask, r->value, op, mask, value);
+	}
+}
+
+static int replay_open(struct pcibx_device *dev, const char *port)
+{
+	struct replay *rp;
+	char magic[8];
+
+	rp = calloc(1, sizeof(*rp));
+	if (!rp) {
+		prerror("Out of memory\n");
+		return -1;
+	}
+	rp->file = port;
+	rp->f = fopen(port, "rb");
+	if (!rp->f) {
+		prerror("Could not open bus trace %s: %s\n",
+			port, strerror(errno));
+		goto err_free;
+	}
+	if (fread(magic, sizeof(magic), 1, rp->f) != 1 ||
+	    memcmp(magic, BUSTRACE_MAGIC, sizeof(magic)) != 0) {
+		prerror("%s is not a bus trace\n", port);
+		goto err_close;
+	}
+	dev->backend_priv = rp;
+
+	return 0;
+
+err_close:
+	fclose(rp->f);
+err_free:
+	free(rp);
+	return -1;
+}
+
+static void replay_close(struct pcibx_device *dev)
+{
+	struct replay *rp = dev->backend_priv;
+
+	prinfo("Replayed %lu bus trace records, %lu mismatches\n",
+	       rp->nr_records, rp->mismatches);
+	fclose(rp->f);
+	free(rp);
+	dev->backend_priv = NULL;
+}
+
+static int replay_read_data(struct pcibx_device *dev, uint8_t *value)
+{
+	struct bustrace_record r;
+
+	if (replay_next(dev, &r))
+		return -1;
+	if (r.op != BUSTRACE_RDATA)
+		replay_mismatch(dev, &r, BUSTRACE_RDATA, 0, 0);
+	*value = r.value;
+
+	return 0;
+}
+
+static int replay_write_data(struct pcibx_device *dev, uint8_t value)
+{
+	struct bustrace_record r;
+
+	if (replay_next(dev, &r))
+		return -1;
+	if (r.op != BUSTRACE_WDATA || r.value != value)
+		replay_mismatch(dev, &r, BUSTRACE_WDATA, 0, value);
+
+	return 0;
+}
+
+static int replay_write_control(struct pcibx_device *dev,
+				uint8_t mask, uint8_t value)
+{
+	struct bustrace_record r;
+
+	if (replay_next(dev, &r))
+		return -1;
+	if (r.op != BUSTRACE_WCTL || r.mask != mask || r.value != value)
+		replay_mismatch(dev, &r, BUSTRACE_WCTL, mask, value);
+
+	return 0;
+}
+
+const struct pcibx_backend pcibx_backend_replay = {
+	.name		= "replay",
+	.open		= replay_open,
+	.close		= replay_close,
+	.read_data	= replay_read_data,
+	.write_data	= replay_write_data,
+	.write_control	= replay_write_control,
+};
@@ -0,0 +1,75 @@
+/*
+
+  Catalyst PCIBX32 PCI Extender control utility
+
+  Copyright (c) 2006-2009 Michael Buesch <mb@bu3sch.de>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Steet, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+
+*/
+
+#ifndef PCIBX_BUSTRACE_H_
+#define PCIBX_BUSTRACE_H_
+
+#include "pcibx_device.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bus transaction trace file format:
+ * An 8 byte header "PCIBXTR1", followed by struct bustrace_record
+ * entries in host byte order. */
+#define BUSTRACE_MAGIC		"PCIBXTR1"
+
+enum bustrace_op {
+	BUSTRACE_WDATA = 1,	/* parport_write_data() */
+	BUSTRACE_RDATA,		/* parport_read_data() */
+	BUSTRACE_WCTL,		/* parport_write_control() */
+};
+
+struct bustrace_record {
+	uint32_t delta;		/* usec since the previous record */
+	uint8_t op;
+	uint8_t mask;		/* BUSTRACE_WCTL only */
+	uint8_t value;
+	uint8_t reserved;
+} __attribute__((packed));
+
+struct pcibx_backend;
+
+struct bustrace {
+	FILE *f;
+	uint64_t last;		/* CLOCK_MONOTONIC nsec of the last record */
+	unsigned long nr_records;
+};
+
+PCIBX_API struct bustrace * bustrace_create(const char *file);
+PCIBX_API void bustrace_close(struct bustrace *t);
+PCIBX_API void bustrace_log(struct bustrace *t, enum bustrace_op op,
+		  uint8_t mask, uint8_t value);
+
+/* Backend that replays a recorded trace. The port is the trace file. */
+PCIBX_API extern const struct pcibx_backend pcibx_backend_replay;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PCIBX_BUSTRACE_H_ */
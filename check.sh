@@ -0,0 +1,86 @@
+#!/bin/bash
+#
+# Run pcibx against the simulated board (-b sim) and compare
+# the output and the port access counts with check/NAME.out.
+# "./check.sh -u" rewrites the expected output instead.
+#
+# GPLv2+
+#
+
+srcdir="$(dirname "$0")"
+PCIBX="$srcdir/pcibx"
+EXPECTED="$srcdir/check"
+
+update=0
+[ "$1" = "-u" ] && update=1
+failed=0
+tmpdir="$(mktemp -d)" || exit 1
+trap 'rm -rf "$tmpdir"' EXIT
+
+function compare # $1=name $2=output file
+{
+	if [ $update -ne 0 ]; then
+		cp "$2" "$EXPECTED/$1.out"
+		return
+	fi
+	if diff -u "$EXPECTED/$1.out" "$2"; then
+		echo "PASS: $1"
+	else
+		echo "FAIL: $1"
+		failed=1
+	fi
+}
+
+# Exact output of a single port run.
+function check # $1=name, $2...=pcibx arguments
+{
+	local name="$1"
+	shift
+
+	"$PCIBX" -b sim "$@" >"$tmpdir/$name" 2>&1
+	echo "exit $?" >>"$tmpdir/$name"
+	compare "$name" "$tmpdir/$name"
+}
+
+# The order of the ports depends on the thread timing. Check that
+# the samples are merged in timestamp order, then compare them
+# without the timestamps and sorted.
+function check_merged # $1=name, $2...=pcibx arguments
+{
+	local name="$1"
+	shift
+
+	"$PCIBX" -b sim -V1 "$@" >"$tmpdir/$name.raw" 2>&1
+	echo "exit $?" >"$tmpdir/$name"
+	if ! grep ' # ' "$tmpdir/$name.raw" | cut -d' ' -f1 | sort -c -g; then
+		echo "unsorted samples" >>"$tmpdir/$name"
+	fi
+	sed -e 's/^.*  # //' "$tmpdir/$name.raw" | sort >>"$tmpdir/$name"
+	compare "$name" "$tmpdir/$name"
+}
+
+[ -x "$PCIBX" ] || { echo "$PCIBX not found. Run make first."; exit 1; }
+[ -d "$EXPECTED" ] || mkdir "$EXPECTED"
+
+check info -p 0 --cmd-printboardid --cmd-printfirmrev --cmd-printstatus \
+	--cmd-measurefreq --cmd-measurev25ref --cmd-getpme
+# The multiplexer settles once per channel, and again after
+# switching a supply.
+check measure_cache -p 0 --cmd-measurea5 --cmd-measurea5 --cmd-aux5 ON \
+	--cmd-measurea5 --cmd-glitch uut:100 --cmd-measurea5
+check reorder -p 0 --reorder --cmd-measurea5 --cmd-measurev5uut \
+	--cmd-measurea5 --cmd-printstatus --cmd-measurev5uut
+check deadband -p 0 -n 5 --cmd-measurea5 --cmd-measurev5uut --deadband a5=0.1
+check estimate -p 0 --estimate --cmd-measurea5 --cmd-uut ON --cmd-printstatus
+check probe -p 0 --probe-timing "$tmpdir/timing"
+check_merged merge -p 0 -p 1 -p 2 -n 3 --cmd-measurea5 --cmd-printstatus
+check_merged merge_async -p 0 -p 1 -p 2 -n 3 --async-output 1024 \
+	--cmd-measurea5 --cmd-printstatus
+
+# A recorded bus trace replays without mismatches.
+"$PCIBX" -b sim -p 0 --trace-record "$tmpdir/trace" \
+	--cmd-measurea5 --cmd-aux33 OFF --cmd-printstatus >/dev/null 2>&1
+check replay -p "$tmpdir/trace" -b replay \
+	--cmd-measurea5 --cmd-aux33 OFF --cmd-printstatus
+
+exit $failed
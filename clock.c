@@ -0,0 +1,170 @@
+/*
+
+  Catalyst PCIBX32 PCI Extender control utility
+
+  Copyright (c) 2006-2009 Michael Buesch <mb@bu3sch.de>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Steet, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+
+*/
+
+#include "clock.h"
+#include "pcibx.h"
+#include "pcibx_device.h"
+#include "utils.h"
+
+#include <string.h>
+#include <math.h>
+
+
+/* Non-overlapping Allan variance at one averaging time.
+ * The samples are averaged over consecutive blocks of "tau"
+ * seconds. AVAR = 1/2 * <(avg[k+1] - avg[k])^2> */
+struct allan {
+	double tau;		/* sec */
+	uint64_t block_start;	/* nsec */
+	double block_sum;
+	unsigned long block_count;
+	double prev_avg;
+	int have_prev;
+	double sum_sq;		/* sum of (avg[k+1] - avg[k])^2 */
+	unsigned long nr_diffs;
+};
+
+struct clock_stats {
+	unsigned long count;
+	/* Welford's running mean and variance */
+	double mean;
+	double m2;
+	double min;
+	double max;
+	/* Least squares fit of the frequency over time. */
+	double sum_t, sum_f, sum_tt, sum_tf;
+	struct allan allan[MAX_CLOCK_TAU];
+};
+
+static void allan_add(struct allan *a, double f, uint64_t t)
+{
+	double avg, d;
+
+	if (!a->block_count)
+		a->block_start = t;
+	a->block_sum += f;
+	a->block_count++;
+	if ((double)(t - a->block_start) / 1000000000.0 < a->tau)
+		return;
+
+	avg = a->block_sum / a->block_count;
+	if (a->have_prev) {
+		d = avg - a->prev_avg;
+		a->sum_sq += d * d;
+		a->nr_diffs++;
+	}
+	a->prev_avg = avg;
+	a->have_prev = 1;
+	a->block_sum = 0.0;
+	a->block_count = 0;
+}
+
+static void clock_add(struct clock_stats *st, double f, double t,
+		      uint64_t now)
+{
+	double delta;
+	int i;
+
+	st->count++;
+	delta = f - st->mean;
+	st->mean += delta / st->count;
+	st->m2 += delta * (f - st->mean);
+	if (st->count == 1 || f < st->min)
+		st->min = f;
+	if (st->count == 1 || f > st->max)
+		st->max = f;
+
+	st->sum_t += t;
+	st->sum_f += f;
+	st->sum_tt += t * t;
+	st->sum_tf += t * f;
+
+	for (i = 0; i < cmdargs.nr_clock_tau; i++)
+		allan_add(&st->allan[i], f, now);
+}
+
+static void clock_print(const struct clock_stats *st, double seconds)
+{
+	double stddev = 0.0, slope = 0.0, denom, adev;
+	const struct allan *a;
+	int i;
+
+	if (st->count < 2) {
+		prinfo("Not enough samples\n");
+		return;
+	}
+	stddev = sqrt(st->m2 / (st->count - 1));
+	denom = st->count * st->sum_tt - st->sum_t * st->sum_t;
+	if (denom > 0.0)
+		slope = (st->count * st->sum_tf - st->sum_t * st->sum_f) / denom;
+
+	prinfo("%lu samples in %.3f sec (%.1f samples/sec)\n",
+	       st->count, seconds, st->count / seconds);
+	prinfo("Mean:   %.6f Mhz\n", st->mean);
+	prinfo("Stddev: %.3f Hz (%.3f ppm)\n",
+	       stddev * 1000000.0, stddev / st->mean * 1000000.0);
+	prinfo("Range:  %.6f - %.6f Mhz (counter resolution %.1f Hz)\n",
+	       st->min, st->max, 100000000.0 / 1048575.0);
+	prinfo("Drift:  %.3f Hz/sec (%.3f ppm/hour)\n",
+	       slope * 1000000.0, slope / st->mean * 1000000.0 * 3600.0);
+	prinfo("Allan deviation:\n");
+	prinfo("  %10s %12s %12s %8s\n", "tau [sec]", "ADEV [Hz]", "ADEV [ppm]", "N");
+	for (i = 0; i < cmdargs.nr_clock_tau; i++) {
+		a = &st->allan[i];
+		if (!a->nr_diffs) {
+			prinfo("  %10.3f %12s %12s %8d\n", a->tau, "-", "-", 0);
+			continue;
+		}
+		adev = sqrt(a->sum_sq / (2.0 * a->nr_diffs));
+		prinfo("  %10.3f %12.3f %12.5f %8lu\n", a->tau,
+		       adev * 1000000.0, adev / st->mean * 1000000.0,
+		       a->nr_diffs);
+	}
+}
+
+int clock_run(struct pcibx_device *dev)
+{
+	struct clock_stats *st;
+	uint64_t t0, now, end = 0;
+	double f;
+	int i;
+
+	st = malloce(sizeof(*st));
+	memset(st, 0, sizeof(*st));
+	for (i = 0; i < cmdargs.nr_clock_tau; i++)
+		st->allan[i].tau = cmdargs.clock_tau[i];
+
+	t0 = monotonic_nsec();
+	if (cmdargs.clock_time > 0.0)
+		end = t0 + (uint64_t)(cmdargs.clock_time * 1000000000.0);
+	do {
+		f = pcibx_cmd_sysfreq(dev);
+		now = monotonic_nsec();
+		clock_add(st, f, (now - t0) / 1000000000.0, now);
+	} while (!terminate && (!end || now < end));
+
+	clock_print(st, (now - t0) / 1000000000.0);
+	free(st);
+
+	return 0;
+}
@@ -0,0 +1,139 @@
+/*
+
+  Catalyst PCIBX32 PCI Extender control utility
+
+  Copyright (c) 2006-2009 Michael Buesch <mb@bu3sch.de>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Steet, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+
+*/
+#include "edf.h"
+#include "utils.h"
+
+#include <time.h>
+#include <errno.h>
+
+
+/* The released task with the earliest deadline, or NULL.
+ * Ties go to the task given first. */
+static struct edf_task * edf_pick(struct edf_task *tasks,
+				  unsigned int nr_tasks, uint64_t now,
+				  uint64_t *next_release)
+{
+	struct edf_task *best = NULL;
+	unsigned int i;
+
+	*next_release = UINT64_MAX;
+	for (i = 0; i < nr_tasks; i++) {
+		if (tasks[i].release > now) {
+			if (tasks[i].release < *next_release)
+				*next_release = tasks[i].release;
+			continue;
+		}
+		if (!best || tasks[i].release + tasks[i].period <
+			     best->release + best->period)
+			best = &tasks[i];
+	}
+
+	return best;
+}
+
+static void edf_sleep_until(uint64_t t)
+{
+	struct timespec ts;
+
+	ts.tv_sec = t / 1000000000;
+	ts.tv_nsec = t % 1000000000;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+		if (terminate)
+			break;
+	}
+}
+
+static void edf_print(const struct edf_task *tasks, unsigned int nr_tasks,
+		      uint64_t elapsed)
+{
+	const double sec = elapsed / 1000000000.0;
+	double util = 0.0, busy = 0.0;
+	unsigned int i;
+
+	prinfo("\nScheduled %.3f sec\n", sec);
+	prinfo("Channel    Period msec  Target Hz  Achieved Hz  Missed  Max late msec  Exec usec\n");
+	for (i = 0; i < nr_tasks; i++) {
+		const struct edf_task *t = &tasks[i];
+		double exec = t->runs ? t->busy / 1000.0 / t->runs : 0.0;
+
+		prinfo("%-10s %11.3f %10.3f %12.3f %7lu %14.3f %10.1f\n",
+		       t->name, t->period / 1000000.0,
+		       1000000000.0 / t->period,
+		       sec > 0.0 ? t->runs / sec : 0.0,
+		       t->missed, t->max_late / 1000000.0, exec);
+		util += exec * 1000.0 / t->period;
+		busy += t->busy;
+	}
+	prinfo("Bus busy: %.1f%%, required utilization: %.1f%%%s\n",
+	       sec > 0.0 ? busy / elapsed * 100.0 : 0.0, util * 100.0,
+	       util > 1.0 ? " (overloaded, deadlines will be missed)" : "");
+}
+
+int edf_run(struct edf_task *tasks, unsigned int nr_tasks, double sec,
+	    edf_run_t run, void *ctx)
+{
+	uint64_t t0, now, end = 0, start, next;
+	struct edf_task *t;
+	unsigned int i;
+	int err = 0;
+
+	t0 = monotonic_nsec();
+	if (sec > 0.0)
+		end = t0 + (uint64_t)(sec * 1000000000.0);
+	for (i = 0; i < nr_tasks; i++)
+		tasks[i].release = t0;
+
+	while (!terminate) {
+		now = monotonic_nsec();
+		if (end && now >= end)
+			break;
+		t = edf_pick(tasks, nr_tasks, now, &next);
+		if (!t) {
+			edf_sleep_until((end && end < next) ? end : next);
+			continue;
+		}
+
+		start = now;
+		err = run(ctx, &t->cmd);
+		if (err)
+			break;
+		now = monotonic_nsec();
+		t->runs++;
+		t->busy += now - start;
+		if (now > t->release + t->period) {
+			t->missed++;
+			if (now - (t->release + t->period) > t->max_late)
+				t->max_late = now - (t->release + t->period);
+		}
+		/* Releases whose deadline already passed are missed
+		 * without running them. */
+		t->release += t->period;
+		while (t->release + t->period <= now) {
+			t->release += t->period;
+			t->missed++;
+		}
+	}
+	edf_print(tasks, nr_tasks, monotonic_nsec() - t0);
+
+	return err;
+}
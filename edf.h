@@ -0,0 +1,50 @@
+/*
+
+  Catalyst PCIBX32 PCI Extender control utility
+
+  Copyright (c) 2006-2009 Michael Buesch <mb@bu3sch.de>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Steet, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+
+*/
+#ifndef PCIBX_EDF_H_
+#define PCIBX_EDF_H_
+
+#include "pcibx.h"
+
+#include <stdint.h>
+
+/* A periodic read command. Its deadline is the next release. */
+struct edf_task {
+	const char *name;
+	struct pcibx_command cmd;
+	uint64_t period;	/* nsec */
+
+	uint64_t release;	/* CLOCK_MONOTONIC nsec */
+	unsigned long runs;
+	unsigned long missed;
+	uint64_t max_late;	/* nsec */
+	uint64_t busy;		/* nsec */
+};
+
+typedef int (*edf_run_t)(void *ctx, const struct pcibx_command *cmd);
+
+/* Run the tasks earliest deadline first for "sec" seconds
+ * (0 = until interrupted) and print the achieved rates. */
+int edf_run(struct edf_task *tasks, unsigned int nr_tasks, double sec,
+	    edf_run_t run, void *ctx);
+
+#endif /* PCIBX_EDF_H_ */
@@ -0,0 +1,110 @@
+/*
+
+  Catalyst PCIBX32 PCI Extender control utility
+
+  Copyright (c) 2006-2009 Michael Buesch <mb@bu3sch.de>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Steet, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+
+*/
+#include "edges.h"
+#include "pcibx.h"
+#include "pcibx_device.h"
+#include "utils.h"
+
+
+static const struct {
+	uint8_t mask;
+	const char *set;
+	const char *cleared;
+} status_edges[] = {
+	{ PCIBX_STATUS_RSTDEASS, "RST# de-asserted", "RST# asserted", },
+	{ PCIBX_STATUS_64BIT, "64-bit handshake", "64-bit handshake lost", },
+	{ PCIBX_STATUS_32BIT, "32-bit handshake", "32-bit handshake lost", },
+	{ PCIBX_STATUS_MHZ, "66 Mhz slot", "33 Mhz slot", },
+	{ PCIBX_STATUS_DUTASS, "DUT asserted", "DUT de-asserted", },
+};
+
+/* The edge happened between the previous poll and "t",
+ * so the poll interval is the resolution. */
+static void print_edge(uint64_t t, uint64_t interval, const char *what)
+{
+	prinfo("%llu.%09llu  %-24s (resolution %.3f usec)\n",
+	       (unsigned long long)(t / 1000000000),
+	       (unsigned long long)(t % 1000000000),
+	       what, interval / 1000.0);
+}
+
+int edges_run(struct pcibx_device *dev)
+{
+	uint64_t t0, t, prev, end = 0, interval, max_interval = 0;
+	unsigned long polls = 0, nr_edges = 0;
+	uint8_t status, pme, old_status, old_pme;
+	char buf[32];
+	unsigned int i;
+
+	pcibx_device_lock(dev);
+	old_status = pcibx_cmd_getstatus(dev);
+	old_pme = pcibx_cmd_getpme(dev);
+	pcibx_device_unlock(dev);
+	t0 = prev = monotonic_nsec();
+	prinfo("%llu.%09llu  Status 0x%02X, PME# 0x%02X\n",
+	       (unsigned long long)(t0 / 1000000000),
+	       (unsigned long long)(t0 % 1000000000),
+	       old_status, old_pme);
+
+	if (cmdargs.edges_time > 0.0)
+		end = t0 + (uint64_t)(cmdargs.edges_time * 1000000000.0);
+	do {
+		/* Lock per poll, so that a shared port is not starved. */
+		pcibx_device_lock(dev);
+		status = pcibx_cmd_getstatus(dev);
+		pme = pcibx_cmd_getpme(dev);
+		pcibx_device_unlock(dev);
+		t = monotonic_nsec();
+		interval = t - prev;
+		prev = t;
+		polls++;
+		if (interval > max_interval)
+			max_interval = interval;
+
+		for (i = 0; i < ARRAY_SIZE(status_edges); i++) {
+			if (!((status ^ old_status) & status_edges[i].mask))
+				continue;
+			print_edge(t, interval, (status & status_edges[i].mask) ?
+					        status_edges[i].set :
+					        status_edges[i].cleared);
+			nr_edges++;
+		}
+		if (pme != old_pme) {
+			snprintf(buf, sizeof(buf), "PME# 0x%02X -> 0x%02X",
+				 old_pme, pme);
+			print_edge(t, interval, buf);
+			nr_edges++;
+		}
+		old_status = status;
+		old_pme = pme;
+	} while (!terminate && (!end || t < end));
+
+	prinfo("\n%lu edges in %lu polls over %.3f sec\n",
+	       nr_edges, polls, (t - t0) / 1000000000.0);
+	if (polls) {
+		prinfo("Poll interval: mean %.3f usec, max %.3f usec\n",
+		       (t - t0) / 1000.0 / polls, max_interval / 1000.0);
+	}
+
+	return 0;
+}
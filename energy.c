@@ -0,0 +1,128 @@
+/*
+
+  Catalyst PCIBX32 PCI Extender control utility
+
+  Copyright (c) 2006-2009 Michael Buesch <mb@bu3sch.de>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Steet, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+
+*/
+
+#include "energy.h"
+#include "utils.h"
+
+#include <string.h>
+
+
+void energy_init(struct energy *e)
+{
+	memset(e, 0, sizeof(*e));
+	e->total.name = "total";
+}
+
+static void account(struct energy_phase *p, int rail,
+		    double joules, double seconds)
+{
+	p->joules[rail] += joules;
+	p->seconds[rail] += seconds;
+}
+
+void energy_sample(struct energy *e, enum measure_id id,
+		   float value, uint64_t time)
+{
+	double power, joules, seconds;
+	int i;
+
+	for (i = 0; i < PCIBX_NR_RAILS; i++) {
+		if (pcibx_rails[i].volt == id) {
+			e->rail[i].volt = value;
+			e->rail[i].have_volt = 1;
+			break;
+		}
+		if (pcibx_rails[i].amp == id) {
+			e->rail[i].amp = value;
+			e->rail[i].have_amp = 1;
+			break;
+		}
+	}
+	if (i >= PCIBX_NR_RAILS)
+		return;
+	if (!e->rail[i].have_volt || !e->rail[i].have_amp)
+		return;
+
+	/* Pair the new reading with the latest reading of the other
+	 * quantity of this rail. */
+	power = (double)e->rail[i].volt * (double)e->rail[i].amp;
+	if (e->rail[i].time && time > e->rail[i].time) {
+		seconds = (double)(time - e->rail[i].time) / 1000000000.0;
+		joules = (power + e->rail[i].power) / 2.0 * seconds;
+		account(&e->total, i, joules, seconds);
+		if (e->phase)
+			account(e->phase, i, joules, seconds);
+	}
+	e->rail[i].power = power;
+	e->rail[i].time = time;
+}
+
+int energy_set_phase(struct energy *e, const char *name)
+{
+	int i;
+
+	for (i = 0; i < e->nr_phases; i++) {
+		if (strcmp(e->phases[i].name, name) == 0) {
+			e->phase = &e->phases[i];
+			return 0;
+		}
+	}
+	if (e->nr_phases == ENERGY_MAX_PHASES) {
+		prerror("Maximum number of energy phases exceed.\n");
+		return -1;
+	}
+	e->phase = &e->phases[e->nr_phases++];
+	e->phase->name = name;
+
+	return 0;
+}
+
+static void print_phase(const struct energy_phase *p)
+{
+	double joules = 0.0, watts = 0.0, seconds = 0.0;
+	int i;
+
+	prinfo("  %-16s", p->name);
+	for (i = 0; i < PCIBX_NR_RAILS; i++) {
+		prinfo(" %12.6f", p->joules[i]);
+		joules += p->joules[i];
+		if (p->seconds[i] > 0.0)
+			watts += p->joules[i] / p->seconds[i];
+		if (p->seconds[i] > seconds)
+			seconds = p->seconds[i];
+	}
+	prinfo(" %12.6f %10.4f %10.3f\n", joules, watts, seconds);
+}
+
+void energy_print(const struct energy *e)
+{
+	int i;
+
+	prinfo("  %-16s", "Phase");
+	for (i = 0; i < PCIBX_NR_RAILS; i++)
+		prinfo(" %10s J", pcibx_rails[i].name);
+	prinfo(" %10s J %8s W %8s s\n", "Total", "Avg", "Time");
+	print_phase(&e->total);
+	for (i = 0; i < e->nr_phases; i++)
+		print_phase(&e->phases[i]);
+}
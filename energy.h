@@ -0,0 +1,65 @@
+/*
+
+  Catalyst PCIBX32 PCI Extender control utility
+
+  Copyright (c) 2006-2009 Michael Buesch <mb@bu3sch.de>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Steet, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+
+*/
+
+#ifndef PCIBX_ENERGY_H_
+#define PCIBX_ENERGY_H_
+
+#include "pcibx_device.h"
+
+#include <stdint.h>
+
+#define ENERGY_MAX_PHASES	32
+
+struct energy_phase {
+	const char *name;
+	double joules[PCIBX_NR_RAILS];
+	double seconds[PCIBX_NR_RAILS];
+};
+
+/* Integrates V*I over time (trapezoidal rule) for every rail. */
+struct energy {
+	struct {
+		float volt;
+		float amp;
+		int have_volt;
+		int have_amp;
+		/* The previous power point. */
+		double power;
+		uint64_t time;	/* CLOCK_MONOTONIC nsec, 0 = none */
+	} rail[PCIBX_NR_RAILS];
+
+	struct energy_phase total;
+	struct energy_phase phases[ENERGY_MAX_PHASES];
+	int nr_phases;
+	struct energy_phase *phase;	/* current phase, or NULL */
+};
+
+void energy_init(struct energy *e);
+/* Feed a measurement taken at "time" (CLOCK_MONOTONIC nsec). */
+void energy_sample(struct energy *e, enum measure_id id,
+		   float value, uint64_t time);
+/* Account all following energy to the phase "name". */
+int energy_set_phase(struct energy *e, const char *name);
+void energy_print(const struct energy *e);
+
+#endif /* PCIBX_ENERGY_H_ */
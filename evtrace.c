@@ -0,0 +1,122 @@
+/*
+
+  Catalyst PCIBX32 PCI Extender control utility
+
+  Copyright (c) 2006-2009 Michael Buesch <mb@bu3sch.de>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Steet, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+
+*/
+#include "evtrace.h"
+#include "utils.h"
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+
+static __thread uint32_t evtrace_tid;
+
+struct evtrace * evtrace_create(size_t size)
+{
+	struct evtrace *t;
+
+	t = malloc(sizeof(*t));
+	if (!t)
+		goto err_nomem;
+	t->events = malloc(sizeof(*t->events) * size);
+	if (!t->events) {
+		free(t);
+		goto err_nomem;
+	}
+	/* Fault in the buffer now, not while tracing. */
+	memset(t->events, 0, sizeof(*t->events) * size);
+	t->size = size;
+	t->count = 0;
+
+	return t;
+
+err_nomem:
+	prerror("Out of memory for %zu trace events\n", size);
+	return NULL;
+}
+
+void evtrace_destroy(struct evtrace *t)
+{
+	if (!t)
+		return;
+	free(t->events);
+	free(t);
+}
+
+void evtrace_log(struct evtrace *t, char phase,
+		 const char *cat, const char *name)
+{
+	struct evtrace_event *e;
+	size_t i;
+
+	i = __atomic_fetch_add(&t->count, 1, __ATOMIC_RELAXED);
+	if (i >= t->size)
+		return;
+	if (!evtrace_tid)
+		evtrace_tid = syscall(SYS_gettid);
+	e = &t->events[i];
+	e->time = monotonic_nsec();
+	e->cat = cat;
+	e->name = name;
+	e->tid = evtrace_tid;
+	e->phase = phase;
+}
+
+int evtrace_write(const struct evtrace *t, const char *file)
+{
+	const struct evtrace_event *e;
+	size_t i, n;
+	FILE *f;
+	int pid = getpid();
+
+	f = fopen(file, "w");
+	if (!f) {
+		prerror("Could not create event trace file %s: %s\n",
+			file, strerror(errno));
+		return -1;
+	}
+	n = t->count < t->size ? t->count : t->size;
+	fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+		"\"args\":{\"name\":\"pcibx\"}}", pid);
+	for (i = 0; i < n; i++) {
+		e = &t->events[i];
+		fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\","
+			"\"ts\":%llu.%03u,\"pid\":%d,\"tid\":%u}",
+			e->name, e->cat, e->phase,
+			(unsigned long long)(e->time / 1000),
+			(unsigned int)(e->time % 1000), pid, e->tid);
+	}
+	fprintf(f, "\n]}\n");
+	if (fclose(f)) {
+		prerror("Could not write event trace file %s: %s\n",
+			file, strerror(errno));
+		return -1;
+	}
+	if (t->count > t->size) {
+		prerror("Event trace buffer full, %zu events dropped\n",
+			t->count - t->size);
+	}
+
+	return 0;
+}
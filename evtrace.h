@@ -0,0 +1,66 @@
+/*
+
+  Catalyst PCIBX32 PCI Extender control utility
+
+  Copyright (c) 2006-2009 Michael Buesch <mb@bu3sch.de>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Steet, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+
+*/
+#ifndef PCIBX_EVTRACE_H_
+#define PCIBX_EVTRACE_H_
+
+#include "pcibx_device.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* In-memory begin/end event trace, dumped in the Chrome trace
+ * event JSON format (chrome://tracing, Perfetto).
+ * The buffer is preallocated. Every event takes a slot with a
+ * single atomic increment, so any thread may log. Events beyond
+ * the buffer size are dropped and counted. */
+
+struct evtrace_event {
+	uint64_t time;		/* CLOCK_MONOTONIC nsec */
+	const char *cat;	/* Static strings only */
+	const char *name;
+	uint32_t tid;
+	char phase;		/* 'B'egin or 'E'nd */
+};
+
+struct evtrace {
+	struct evtrace_event *events;
+	size_t size;
+	size_t count;		/* Slots taken. May exceed size. */
+};
+
+PCIBX_API struct evtrace * evtrace_create(size_t size);
+PCIBX_API void evtrace_destroy(struct evtrace *t);
+PCIBX_API void evtrace_log(struct evtrace *t, char phase,
+		 const char *cat, const char *name);
+/* Write the trace to "file". The loggers must have stopped. */
+PCIBX_API int evtrace_write(const struct evtrace *t, const char *file);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PCIBX_EVTRACE_H_ */
@@ -0,0 +1,172 @@
+/*
+
+  Catalyst PCIBX32 PCI Extender control utility
+
+  Copyright (c) 2006-2009 Michael Buesch <mb@bu3sch.de>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Steet, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+
+*/
+#include "glitch.h"
+#include "pcibx.h"
+#include "utils.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+
+static const struct {
+	const char *name;
+	enum pcibx_switch rail;
+} glitch_rails[] = {
+	{ "uut",	PCIBX_SWITCH_UUT, },
+	{ "aux5",	PCIBX_SWITCH_AUX5, },
+	{ "aux33",	PCIBX_SWITCH_AUX33, },
+};
+
+const char * glitch_rail_name(enum pcibx_switch rail)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(glitch_rails); i++) {
+		if (glitch_rails[i].rail == rail)
+			return glitch_rails[i].name;
+	}
+	return "?";
+}
+
+/* Parse a duration with an optional "us", "ms" or "s" suffix.
+ * The default unit is usec. */
+static int parse_duration(const char *str, char **end, unsigned int *usec)
+{
+	double v, scale = 1.0;
+
+	errno = 0;
+	v = strtod(str, end);
+	if (errno || *end == str || v < 0.0)
+		return -1;
+	if (strncmp(*end, "us", 2) == 0) {
+		*end += 2;
+	} else if (strncmp(*end, "ms", 2) == 0) {
+		scale = 1000.0;
+		*end += 2;
+	} else if (**end == 's') {
+		scale = 1000000.0;
+		*end += 1;
+	}
+	v *= scale;
+	if (v > 4000000000.0)
+		return -1;
+	*usec = (unsigned int)(v + 0.5);
+
+	return 0;
+}
+
+struct glitch * glitch_parse(const char *spec)
+{
+	struct glitch *g;
+	const char *colon;
+	char *end;
+	unsigned int i;
+	size_t len;
+
+	g = malloce(sizeof(*g));
+	g->count = 1;
+	g->period = 0;
+
+	colon = strchr(spec, ':');
+	if (!colon)
+		goto error;
+	len = colon - spec;
+	for (i = 0; i < ARRAY_SIZE(glitch_rails); i++) {
+		if (strlen(glitch_rails[i].name) == len &&
+		    strncmp(glitch_rails[i].name, spec, len) == 0)
+			break;
+	}
+	if (i == ARRAY_SIZE(glitch_rails))
+		goto error;
+	g->rail = glitch_rails[i].rail;
+
+	if (parse_duration(colon + 1, &end, &g->width) || !g->width)
+		goto error;
+	if (*end == ':') {
+		errno = 0;
+		g->count = strtoul(end + 1, &end, 10);
+		if (errno || !g->count)
+			goto error;
+	}
+	if (*end == ':') {
+		if (parse_duration(end + 1, &end, &g->period))
+			goto error;
+	}
+	if (*end != '\0')
+		goto error;
+	if (g->count > 1 && g->period <= g->width) {
+		prerror("--cmd-glitch: The period must be longer "
+			"than the width: %s\n", spec);
+		free(g);
+		return NULL;
+	}
+
+	return g;
+error:
+	prerror("Invalid parameter to --cmd-glitch: %s\n", spec);
+	free(g);
+	return NULL;
+}
+
+static void glitch_switch_off(struct pcibx_device *dev,
+			      enum pcibx_switch rail)
+{
+	switch (rail) {
+	case PCIBX_SWITCH_UUT:
+		pcibx_cmd_uut_pwr_nowait(dev, 0);
+		break;
+	case PCIBX_SWITCH_AUX5:
+		pcibx_cmd_aux5(dev, 0);
+		break;
+	case PCIBX_SWITCH_AUX33:
+		pcibx_cmd_aux33(dev, 0);
+		break;
+	}
+}
+
+void glitch_run(struct pcibx_device *dev, const struct glitch *g,
+		glitch_pulse_t pulse, void *ctx)
+{
+	uint64_t t_off, t_on, start = 0;
+	unsigned int i;
+	int state;
+
+	/* Hold the device for the whole pattern, so that no other
+	 * user of a shared port delays an edge. */
+	pcibx_device_lock(dev);
+	/* An AUX rail of unknown state is taken as on. */
+	state = pcibx_device_switch_state(dev, g->rail);
+	for (i = 0; i < g->count && !terminate; i++) {
+		if (i)
+			pcibx_device_wait_until(dev, start + (uint64_t)i * g->period * 1000);
+		pcibx_cmd_glitch(dev, g->rail, g->width, &t_off, &t_on);
+		if (!i)
+			start = t_off;
+		pulse(ctx, g, i + 1, t_off, t_on);
+	}
+	/* The pattern ends with the rail on. Restore an off rail. */
+	if (state == 0)
+		glitch_switch_off(dev, g->rail);
+	pcibx_device_unlock(dev);
+}
@@ -0,0 +1,49 @@
+/*
+
+  Catalyst PCIBX32 PCI Extender control utility
+
+  Copyright (c) 2006-2009 Michael Buesch <mb@bu3sch.de>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Steet, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+
+*/
+#ifndef PCIBX_GLITCH_H_
+#define PCIBX_GLITCH_H_
+
+#include "pcibx_device.h"
+
+/* A pattern of power glitches. The rail is switched off for
+ * "width" usec, "count" times, every "period" usec. */
+struct glitch {
+	enum pcibx_switch rail;
+	unsigned int width;
+	unsigned int count;
+	unsigned int period;
+};
+
+/* Called for every pulse "nr" (from 1) with the CLOCK_MONOTONIC
+ * times of its off and on edges. */
+typedef void (*glitch_pulse_t)(void *ctx, const struct glitch *g,
+			       unsigned int nr, uint64_t t_off, uint64_t t_on);
+
+/* Parse RAIL:WIDTH[:COUNT[:PERIOD]]. Returns NULL on error. */
+struct glitch * glitch_parse(const char *spec);
+const char * glitch_rail_name(enum pcibx_switch rail);
+/* Run the pattern and report the edges of each pulse. */
+void glitch_run(struct pcibx_device *dev, const struct glitch *g,
+		glitch_pulse_t pulse, void *ctx);
+
+#endif /* PCIBX_GLITCH_H_ */
@@ -0,0 +1,133 @@
+/*
+
+  Catalyst PCIBX32 PCI Extender control utility
+
+  Copyright (c) 2006-2009 Michael Buesch <mb@bu3sch.de>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Steet, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+
+*/
+
+#include "histogram.h"
+#include "utils.h"
+
+#include <string.h>
+
+
+static unsigned int bucket_index(uint64_t value)
+{
+	unsigned int shift;
+
+	if (value < HISTOGRAM_SUB_COUNT)
+		return value;
+	shift = 63 - __builtin_clzll(value) - HISTOGRAM_SUB_BITS;
+
+	return (shift + 1) * HISTOGRAM_SUB_COUNT +
+	       (unsigned int)(value >> shift) - HISTOGRAM_SUB_COUNT;
+}
+
+static uint64_t bucket_low(unsigned int index)
+{
+	unsigned int shift;
+
+	if (index < HISTOGRAM_SUB_COUNT)
+		return index;
+	shift = index / HISTOGRAM_SUB_COUNT - 1;
+
+	return (uint64_t)(HISTOGRAM_SUB_COUNT + index % HISTOGRAM_SUB_COUNT) << shift;
+}
+
+static uint64_t bucket_high(unsigned int index)
+{
+	if (index + 1 >= HISTOGRAM_NR_BUCKETS)
+		return UINT64_MAX;
+	return bucket_low(index + 1) - 1;
+}
+
+void histogram_init(struct histogram *h)
+{
+	memset(h, 0, sizeof(*h));
+	h->min = UINT64_MAX;
+}
+
+void histogram_add(struct histogram *h, uint64_t value)
+{
+	h->buckets[bucket_index(value)]++;
+	h->count++;
+	h->sum += value;
+	if (value < h->min)
+		h->min = value;
+	if (value > h->max)
+		h->max = value;
+}
+
+uint64_t histogram_percentile(const struct histogram *h, double percent)
+{
+	uint64_t rank, seen = 0;
+	unsigned int i;
+
+	if (!h->count)
+		return 0;
+	rank = (uint64_t)(percent / 100.0 * h->count + 0.5);
+	if (rank < 1)
+		rank = 1;
+	for (i = 0; i < HISTOGRAM_NR_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen >= rank)
+			break;
+	}
+	if (i >= HISTOGRAM_NR_BUCKETS || bucket_high(i) > h->max)
+		return h->max;
+
+	return bucket_high(i);
+}
+
+void histogram_print(const struct histogram *h,
+		     const char *name, const char *unit)
+{
+	uint32_t most = 0;
+	unsigned int i;
+	int bar;
+
+	if (!h->count) {
+		prinfo("%s: no samples\n", name);
+		return;
+	}
+	prinfo("%s: %llu samples, min %llu, mean %.1f, "
+	       "p50 %llu, p90 %llu, p99 %llu, max %llu %s\n",
+	       name, (unsigned long long)h->count,
+	       (unsigned long long)h->min, h->sum / h->count,
+	       (unsigned long long)histogram_percentile(h, 50.0),
+	       (unsigned long long)histogram_percentile(h, 90.0),
+	       (unsigned long long)histogram_percentile(h, 99.0),
+	       (unsigned long long)h->max, unit);
+
+	for (i = 0; i < HISTOGRAM_NR_BUCKETS; i++) {
+		if (h->buckets[i] > most)
+			most = h->buckets[i];
+	}
+	for (i = 0; i < HISTOGRAM_NR_BUCKETS; i++) {
+		if (!h->buckets[i])
+			continue;
+		prinfo("  %10llu - %-10llu %s %8u |",
+		       (unsigned long long)bucket_low(i),
+		       (unsigned long long)bucket_high(i), unit,
+		       h->buckets[i]);
+		for (bar = (int)((uint64_t)h->buckets[i] * 40 / most); bar > 0; bar--)
+			prinfo("#");
+		prinfo("\n");
+	}
+}
@@ -0,0 +1,52 @@
+/*
+
+  Catalyst PCIBX32 PCI Extender control utility
+
+  Copyright (c) 2006-2009 Michael Buesch <mb@bu3sch.de>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Steet, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+
+*/
+
+#ifndef PCIBX_HISTOGRAM_H_
+#define PCIBX_HISTOGRAM_H_
+
+#include <stdint.h>
+
+/* Log-linear (HDR style) histogram.
+ * Every power of two is split into 2^HISTOGRAM_SUB_BITS buckets,
+ * so the relative bucket width is below 1/2^HISTOGRAM_SUB_BITS. */
+#define HISTOGRAM_SUB_BITS	4
+#define HISTOGRAM_SUB_COUNT	(1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_NR_BUCKETS	((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_COUNT)
+
+struct histogram {
+	uint64_t count;
+	uint64_t min;
+	uint64_t max;
+	double sum;
+	uint32_t buckets[HISTOGRAM_NR_BUCKETS];
+};
+
+void histogram_init(struct histogram *h);
+void histogram_add(struct histogram *h, uint64_t value);
+/* Returns the value below which "percent" of all values are. */
+uint64_t histogram_percentile(const struct histogram *h, double percent);
+/* Print a summary line and the non-empty buckets. */
+void histogram_print(const struct histogram *h,
+		     const char *name, const char *unit);
+
+#endif /* PCIBX_HISTOGRAM_H_ */
@@ -0,0 +1,106 @@
+/*
+
+  Catalyst PCIBX32 PCI Extender control utility
+
+  Copyright (c) 2006-2009 Michael Buesch <mb@bu3sch.de>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Steet, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+
+*/
+
+#include "inrush.h"
+#include "pcibx.h"
+#include "pcibx_device.h"
+#include "utils.h"
+
+#include <string.h>
+
+
+#define INRUSH_MAX_SAMPLES	65536
+
+struct inrush_sample {
+	uint32_t time;		/* usec after UUT power on */
+	float amp;
+};
+
+int inrush_run(struct pcibx_device *dev)
+{
+	const int channel = cmdargs.inrush_channel;
+	const uint64_t timeout = (uint64_t)cmdargs.inrush_timeout * 1000000;
+	struct inrush_sample *wave;
+	unsigned int i, n = 0, peak = 0;
+	uint64_t t0, t, t_rst = 0;
+	uint8_t status = 0;
+	float amp;
+
+	wave = malloce(sizeof(*wave) * INRUSH_MAX_SAMPLES);
+
+	pcibx_device_lock(dev);
+	/* Arm: UUT off, global power on and the multiplexer
+	 * settled on the channel, so that the first conversion
+	 * can start right after power on. */
+	pcibx_cmd_uut_pwr_nowait(dev, 0);
+	pcibx_cmd_global_pwr(dev, 1);
+	msleep(cmdargs.inrush_off);
+	pcibx_cmd_measure(dev, channel);
+	pcibx_cmd_clearbitstat(dev);
+
+	pcibx_cmd_uut_pwr_nowait(dev, 1);
+	t0 = monotonic_nsec();
+	while (n < INRUSH_MAX_SAMPLES) {
+		/* The step is what we sample here. */
+		amp = pcibx_cmd_measure_nosettle(dev, channel);
+		t = monotonic_nsec();
+		wave[n].time = (t - t0) / 1000;
+		wave[n].amp = amp;
+		if (amp > wave[peak].amp)
+			peak = n;
+		n++;
+		status = pcibx_cmd_getstatus(dev);
+		if (status & PCIBX_STATUS_RSTDEASS) {
+			t_rst = monotonic_nsec();
+			break;
+		}
+		if (t - t0 >= timeout || terminate)
+			break;
+	}
+	pcibx_device_unlock(dev);
+
+	prinfo("Inrush current of %s after UUT power on:\n",
+	       pcibx_measure_name(channel));
+	for (i = 0; i < n; i++) {
+		prinfo("  %10.3f msec  %f Ampere%s\n",
+		       wave[i].time / 1000.0, wave[i].amp,
+		       i == peak ? "  <- peak" : "");
+	}
+	prinfo("\n%u samples", n);
+	if (n > 1) {
+		prinfo(", %.3f msec sample interval",
+		       (wave[n - 1].time - wave[0].time) / 1000.0 / (n - 1));
+	}
+	prinfo("\n");
+	if (n) {
+		prinfo("Peak current: %f Ampere, %.3f msec after power on\n",
+		       wave[peak].amp, wave[peak].time / 1000.0);
+	}
+	if (status & PCIBX_STATUS_RSTDEASS)
+		prinfo("RST# de-asserted after %.3f msec\n", (t_rst - t0) / 1000000.0);
+	else
+		prinfo("RST# not de-asserted within %.3f msec\n", (t - t0) / 1000000.0);
+	free(wave);
+
+	return (status & PCIBX_STATUS_RSTDEASS) ? 0 : -1;
+}
@@ -0,0 +1,186 @@
+/*
+
+  Catalyst PCIBX32 PCI Extender control utility
+
+  Copyright (c) 2006-2009 Michael Buesch <mb@bu3sch.de>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Steet, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+
+*/
+
+#include "metrics.h"
+#include "utils.h"
+
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+
+
+struct pcibx_metrics * metrics_create(const char *file,
+				      unsigned int interval_msec)
+{
+	struct pcibx_metrics *m;
+
+	m = malloce(sizeof(*m));
+	memset(m, 0, sizeof(*m));
+	m->file = file;
+	m->tmpfile = malloce(strlen(file) + 5);
+	sprintf(m->tmpfile, "%s.tmp", file);
+	m->interval = (uint64_t)interval_msec * 1000000;
+
+	return m;
+}
+
+void metrics_destroy(struct pcibx_metrics *m)
+{
+	if (!m)
+		return;
+	free(m->tmpfile);
+	free(m);
+}
+
+static void write_header(FILE *f, const char *name,
+			 const char *type, const char *help)
+{
+	fprintf(f, "# HELP %s %s\n", name, help);
+	fprintf(f, "# TYPE %s %s\n", name, type);
+}
+
+static void write_sample(FILE *f, const char *name,
+			 const char *port, const char *label,
+			 const char *labelval,
+			 const struct pcibx_telemetry_sample *s)
+{
+	if (!s->count)
+		return;
+	if (label)
+		fprintf(f, "%s{port=\"%s\",%s=\"%s\"} %f\n",
+			name, port, label, labelval, s->value);
+	else
+		fprintf(f, "%s{port=\"%s\"} %f\n", name, port, s->value);
+}
+
+static uint64_t nr_samples(const struct pcibx_telemetry *t)
+{
+	uint64_t count;
+	int i;
+
+	count = t->sysfreq.count + t->status.count + t->pme.count;
+	for (i = 0; i < PCIBX_NR_MEASURE; i++)
+		count += t->measure[i].count;
+
+	return count;
+}
+
+int metrics_write(struct pcibx_metrics *m,
+		  const struct pcibx_telemetry *t,
+		  const struct pcibx_device *dev)
+{
+	const struct pcibx_telemetry_sample *v, *a;
+	const char *port = dev->port;
+	uint64_t now, samples;
+	unsigned int i;
+	FILE *f;
+
+	now = monotonic_nsec();
+	samples = nr_samples(t);
+	if (m->last_write) {
+		m->samples_per_sec = (double)(samples - m->last_samples) *
+				     1000000000.0 / (double)(now - m->last_write);
+	}
+	m->last_write = now;
+	m->last_samples = samples;
+
+	f = fopen(m->tmpfile, "w");
+	if (!f)
+		goto error;
+
+	write_header(f, "pcibx_volts", "gauge", "Latest voltage reading.");
+	for (i = 0; i < PCIBX_NR_MEASURE; i++) {
+		if (pcibx_measure_is_current(i + MEASURE_V25REF))
+			continue;
+		write_sample(f, "pcibx_volts", port, "channel",
+			     pcibx_measure_name(i + MEASURE_V25REF),
+			     &t->measure[i]);
+	}
+	write_header(f, "pcibx_amps", "gauge", "Latest current reading.");
+	for (i = 0; i < PCIBX_NR_RAILS; i++) {
+		write_sample(f, "pcibx_amps", port, "rail", pcibx_rails[i].name,
+			     &t->measure[MEASURE_INDEX(pcibx_rails[i].amp)]);
+	}
+	write_header(f, "pcibx_watts", "gauge",
+		     "Latest power, from the latest voltage and current readings.");
+	for (i = 0; i < PCIBX_NR_RAILS; i++) {
+		v = &t->measure[MEASURE_INDEX(pcibx_rails[i].volt)];
+		a = &t->measure[MEASURE_INDEX(pcibx_rails[i].amp)];
+		if (!v->count || !a->count)
+			continue;
+		fprintf(f, "pcibx_watts{port=\"%s\",rail=\"%s\"} %f\n",
+			port, pcibx_rails[i].name, v->value * a->value);
+	}
+	write_header(f, "pcibx_sysfreq_mhz", "gauge", "Latest system frequency.");
+	write_sample(f, "pcibx_sysfreq_mhz", port, NULL, NULL, &t->sysfreq);
+	write_header(f, "pcibx_status", "gauge", "Latest board status bits.");
+	write_sample(f, "pcibx_status", port, NULL, NULL, &t->status);
+	write_header(f, "pcibx_pme", "gauge", "Latest PME# status.");
+	write_sample(f, "pcibx_pme", port, NULL, NULL, &t->pme);
+
+	write_header(f, "pcibx_samples_total", "counter", "Number of samples taken.");
+	fprintf(f, "pcibx_samples_total{port=\"%s\"} %llu\n",
+		port, (unsigned long long)samples);
+	write_header(f, "pcibx_samples_per_second", "gauge",
+		     "Sample rate since the previous metrics update.");
+	fprintf(f, "pcibx_samples_per_second{port=\"%s\"} %f\n",
+		port, m->samples_per_sec);
+	write_header(f, "pcibx_metrics_late_total", "counter",
+		     "Number of metrics updates delayed by more than one interval.");
+	fprintf(f, "pcibx_metrics_late_total{port=\"%s\"} %lu\n",
+		port, m->late);
+	write_header(f, "pcibx_io_errors_total", "counter",
+		     "Number of failed parallel port accesses.");
+	fprintf(f, "pcibx_io_errors_total{port=\"%s\"} %lu\n",
+		port, dev->io_errors);
+
+	if (fclose(f))
+		goto error;
+	if (rename(m->tmpfile, m->file))
+		goto error;
+
+	return 0;
+error:
+	if (m->write_errors++ == 0) {
+		prerror("Could not write metrics file %s: %s\n",
+			m->file, strerror(errno));
+	}
+	return -1;
+}
+
+void metrics_poll(struct pcibx_metrics *m,
+		  const struct pcibx_telemetry *t,
+		  const struct pcibx_device *dev)
+{
+	uint64_t now;
+
+	if (!m)
+		return;
+	now = monotonic_nsec();
+	if (m->last_write && now - m->last_write < m->interval)
+		return;
+	/* The acquisition blocked us for more than a whole interval. */
+	if (m->last_write && now - m->last_write >= 2 * m->interval)
+		m->late++;
+	metrics_write(m, t, dev);
+}
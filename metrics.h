@@ -0,0 +1,57 @@
+/*
+
+  Catalyst PCIBX32 PCI Extender control utility
+
+  Copyright (c) 2006-2009 Michael Buesch <mb@bu3sch.de>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Steet, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+
+*/
+
+#ifndef PCIBX_METRICS_H_
+#define PCIBX_METRICS_H_
+
+#include "pcibx_device.h"
+#include "telemetry.h"
+
+#include <stdint.h>
+
+struct pcibx_metrics {
+	const char *file;
+	char *tmpfile;
+	uint64_t interval;	/* nsec */
+
+	uint64_t last_write;	/* CLOCK_MONOTONIC nsec */
+	uint64_t last_samples;
+	double samples_per_sec;
+	unsigned long late;	/* updates late by a whole interval */
+	unsigned long write_errors;
+};
+
+struct pcibx_metrics * metrics_create(const char *file,
+				      unsigned int interval_msec);
+void metrics_destroy(struct pcibx_metrics *m);
+
+/* Rewrite the metrics file, if the update interval elapsed. */
+void metrics_poll(struct pcibx_metrics *m,
+		  const struct pcibx_telemetry *t,
+		  const struct pcibx_device *dev);
+/* Unconditionally rewrite the metrics file. */
+int metrics_write(struct pcibx_metrics *m,
+		  const struct pcibx_telemetry *t,
+		  const struct pcibx_device *dev);
+
+#endif /* PCIBX_METRICS_H_ */
@@ -0,0 +1,153 @@
+/*
+
+  Catalyst PCIBX32 PCI Extender control utility
+
+  Copyright (c) 2006-2009 Michael Buesch <mb@bu3sch.de>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Steet, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+
+*/
+
+#include "optimize.h"
+#include "pcibx.h"
+#include "utils.h"
+
+#include <string.h>
+
+
+/* Commands that change the state of the board (or of the energy
+ * accounting). Nothing is moved across them. */
+static int is_barrier(const struct pcibx_command *cmd)
+{
+	switch (cmd->id) {
+	case CMD_GLOB:
+	case CMD_UUT:
+	case CMD_CLEARBITSTAT:
+	case CMD_AUX5:
+	case CMD_AUX33:
+	case CMD_FASTRAMP:
+	case CMD_RST:
+	case CMD_RSTDEFAULT:
+	case CMD_PHASE:
+	case CMD_GLITCH:
+		return 1;
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+static int is_measure(enum command_id id)
+{
+	return id >= CMD_MEASUREV25REF && id <= CMD_MEASUREA33;
+}
+
+static int same_command(const struct pcibx_command *a,
+			const struct pcibx_command *b)
+{
+	if (a->id != b->id)
+		return 0;
+	switch (a->id) {
+	case CMD_GLOB:
+	case CMD_UUT:
+	case CMD_AUX5:
+	case CMD_AUX33:
+	case CMD_FASTRAMP:
+		return a->u.boolean == b->u.boolean;
+	case CMD_RST:
+		return a->u.d == b->u.d;
+	case CMD_PHASE:
+		return strcmp(a->u.str, b->u.str) == 0;
+	case CMD_GLITCH:
+		/* Every glitch is an event of its own. */
+		return 0;
+	default:
+		break;
+	}
+
+	return 1;
+}
+
+/* Sort key of a read command. The measurement channel that is
+ * still selected from the previous segment goes first, so it
+ * does not need to be selected again. */
+static int read_key(const struct pcibx_command *cmd, int selected)
+{
+	if (cmd->id == selected)
+		return -1;
+	return cmd->id;
+}
+
+/* Sort the reads in cmds[0..nr-1] by register and channel (stable)
+ * and drop the duplicates. Returns the new number of commands. */
+static int optimize_segment(struct pcibx_command *cmds, int nr,
+			    int *selected)
+{
+	struct pcibx_command tmp;
+	int i, j, n;
+
+	for (i = 1; i < nr; i++) {
+		tmp = cmds[i];
+		for (j = i; j > 0; j--) {
+			if (read_key(&cmds[j - 1], *selected) <=
+			    read_key(&tmp, *selected))
+				break;
+			cmds[j] = cmds[j - 1];
+		}
+		cmds[j] = tmp;
+	}
+	for (i = 0, n = 0; i < nr; i++) {
+		if (n && same_command(&cmds[n - 1], &cmds[i]))
+			continue;
+		cmds[n++] = cmds[i];
+	}
+	for (i = n - 1; i >= 0; i--) {
+		if (is_measure(cmds[i].id)) {
+			*selected = cmds[i].id;
+			break;
+		}
+	}
+
+	return n;
+}
+
+int optimize_commands(struct pcibx_command *cmds, int nr_commands)
+{
+	int selected = -1;
+	int start, i, n = 0;
+
+	i = 0;
+	while (i < nr_commands) {
+		if (is_barrier(&cmds[i])) {
+			/* Writing the same value twice in a row
+			 * has no effect. */
+			if (!n || !same_command(&cmds[n - 1], &cmds[i]))
+				cmds[n++] = cmds[i];
+			i++;
+			continue;
+		}
+		start = i;
+		while (i < nr_commands && !is_barrier(&cmds[i]))
+			i++;
+		memmove(&cmds[n], &cmds[start], (i - start) * sizeof(*cmds));
+		n += optimize_segment(&cmds[n], i - start, &selected);
+	}
+	if (cmdargs.verbose >= 1 && n != nr_commands)
+		prinfo("Optimized %d commands to %d\n", nr_commands, n);
+
+	return n;
+}
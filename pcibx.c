@@ -23,6 +23,25 @@
 
 #include "pcibx.h"
 #include "pcibx_device.h"
+#include "telemetry.h"
+#include "metrics.h"
+#include "stress.h"
+#include "watchdog.h"
+#include "optimize.h"
+#include "spsc.h"
+#include "clock.h"
+#include "probe.h"
+#include "rawlog.h"
+#include "segment.h"
+#include "inrush.h"
+#include "glitch.h"
+#include "edges.h"
+#include "edf.h"
+#include "energy.h"
+#include "histogram.h"
+#include "bustrace.h"
+#include "evtrace.h"
+#include "simboard.h"
 
 #include <string.h>
 #include <errno.h>
@@ -32,10 +51,79 @@
 #include <stdarg.h>
 #include <time.h>
 #include <sys/time.h>
-
+#include <pthread.h>
+
+
+/* One sample from a device command, to be printed. */
+struct sample {
+	struct timeval time;	/* relative to starttime */
+	unsigned int port;
+	enum command_id cmd;
+	union {
+		uint8_t v;
+		float f;
+		struct {
+			enum pcibx_switch rail;
+			unsigned int nr;
+			float width;	/* usec */
+		} glitch;
+	} u;
+};
+
+/* Every port is driven by its own worker thread. */
+struct worker {
+	unsigned int index;
+	pthread_t thread;
+	struct pcibx_device dev;
+	struct bustrace *trace;
+	struct rawlog *raw;
+	struct pcibx_sim *sim;
+	char *shm_name;
+	char *metrics_file;
+	struct pcibx_telemetry *telemetry;
+	struct pcibx_metrics *metrics;
+	struct energy *energy;
+	struct segmenter *segment;
+	/* Command latencies in usec, by command_id. */
+	struct histogram *latency;
+
+	/* Deadband filter state, by command_id. */
+	struct {
+		int valid;
+		double last;		/* last emitted value */
+		uint64_t time;		/* usec of the last emitted value */
+		unsigned long total;
+		unsigned long suppressed;
+	} deadband[NR_COMMAND_IDS];
+
+	/* Samples of the current cycle. */
+	struct sample samples[MAX_COMMAND];
+	unsigned int nr_samples;
+	int err;
+};
 
 struct cmdline_args cmdargs;
 struct timeval starttime;
+volatile sig_atomic_t terminate;
+
+static struct worker *workers;
+static pthread_barrier_t cycle_start;
+static pthread_barrier_t cycle_done;
+static int stop_workers;
+
+/* Sample queue to the output thread, if --async-output.
+ * Every cycle is pushed as the samples of each worker in turn,
+ * terminated by a sample with cmd NR_COMMAND_IDS. */
+static struct spsc_ring *output_ring;
+static pthread_t output_thread_id;
+static pthread_mutex_t output_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t output_cond = PTHREAD_COND_INITIALIZER;
+static int output_pending;
+static int stop_output;
+static unsigned long output_dropped;
+
+/* Timeline of all workers, if --event-trace */
+static struct evtrace *evtrace;
 
 
 /* Subtract the `struct timeval' values X and Y,
@@ -71,129 +159,527 @@ static int timeval_subtract(struct timeval *result,
 	return x->tv_sec < y->tv_sec;
 }
 
-#define print_data(description, format, units, ...) do { \
-	struct timeval tmp, tv;						\
-	int err;							\
-									\
-	if (cmdargs.verbose >= 1) {					\
-		err = gettimeofday(&tmp, NULL);				\
-		if (err) {						\
-			prerror("gettimeofday() failure!\n");		\
-			break;						\
-		}							\
-		err = timeval_subtract(&tv, &tmp, &starttime);		\
-		if (err) {						\
-			prerror("timeval_subtract() went negative!\n");	\
-			break;						\
-		}							\
-		prinfo("%ld.%06ld " format "  # ",			\
-		       tv.tv_sec, tv.tv_usec,				\
-		       __VA_ARGS__);					\
-	}								\
-	prinfo(description ": " format " " units "\n", __VA_ARGS__);	\
-} while (0)
-
-static int send_commands(struct pcibx_device *dev)
-{
-	struct pcibx_command *cmd;
-	uint8_t v;
-	float f;
-	int i;
+static const char *command_names[NR_COMMAND_IDS] = {
+	[CMD_GLOB]		= "glob",
+	[CMD_UUT]		= "uut",
+	[CMD_PRINTBOARDID]	= "printboardid",
+	[CMD_PRINTFIRMREV]	= "printfirmrev",
+	[CMD_PRINTSTATUS]	= "printstatus",
+	[CMD_CLEARBITSTAT]	= "clearbitstat",
+	[CMD_AUX5]		= "aux5",
+	[CMD_AUX33]		= "aux33",
+	[CMD_MEASUREFREQ]	= "measurefreq",
+	[CMD_MEASUREV25REF]	= "measurev25ref",
+	[CMD_MEASUREV12UUT]	= "measurev12uut",
+	[CMD_MEASUREV5UUT]	= "measurev5uut",
+	[CMD_MEASUREV33UUT]	= "measurev33uut",
+	[CMD_MEASUREV5AUX]	= "measurev5aux",
+	[CMD_MEASUREA5]		= "measurea5",
+	[CMD_MEASUREA12]	= "measurea12",
+	[CMD_MEASUREA33]	= "measurea33",
+	[CMD_FASTRAMP]		= "fastramp",
+	[CMD_RST]		= "rst",
+	[CMD_RSTDEFAULT]	= "rstdefault",
+	[CMD_GETPME]		= "getpme",
+	[CMD_PHASE]		= "phase",
+	[CMD_GLITCH]		= "glitch",
+};
+
+static const struct {
+	const char *description;
+	const char *units;
+} sample_info[] = {
+	[CMD_PRINTBOARDID]	= { "Board ID", "", },
+	[CMD_PRINTFIRMREV]	= { "Firmware revision", "", },
+	[CMD_PRINTSTATUS]	= { "Board status", "", },
+	[CMD_MEASUREFREQ]	= { "Measured system frequency", "Mhz", },
+	[CMD_MEASUREV25REF]	= { "Measured +2.5V Reference", "Volt", },
+	[CMD_MEASUREV12UUT]	= { "Measured +12V UUT", "Volt", },
+	[CMD_MEASUREV5UUT]	= { "Measured +5V UUT", "Volt", },
+	[CMD_MEASUREV33UUT]	= { "Measured +33V UUT", "Volt", },
+	[CMD_MEASUREV5AUX]	= { "Measured +5V AUX", "Volt", },
+	[CMD_MEASUREA5]		= { "Measured +5V Current", "Ampere", },
+	[CMD_MEASUREA12]	= { "Measured +12V Current", "Ampere", },
+	[CMD_MEASUREA33]	= { "Measured +3.3V Current", "Ampere", },
+	[CMD_GETPME]		= { "PME# status", "", },
+	[CMD_GLITCH]		= { "Glitch width", "usec", },
+};
+
+static int format_sample_value(char *buf, size_t size,
+			       const struct sample *s)
+{
+	uint8_t v = s->u.v;
+
+	switch (s->cmd) {
+	case CMD_PRINTSTATUS:
+		return snprintf(buf, size, "%s;  %s;  %s;  %s;  %s",
+		       (v & PCIBX_STATUS_RSTDEASS) ? "RST# de-asserted"
+						   : "RST# asserted",
+		       (v & PCIBX_STATUS_64BIT) ? "64-bit operation established"
+						: "No 64-bit handshake detected",
+		       (v & PCIBX_STATUS_32BIT) ? "32-bit operation established"
+						: "No 32-bit handshake detected",
+		       (v & PCIBX_STATUS_MHZ) ? "66 Mhz enabled slot"
+					      : "33 Mhz enabled slot",
+		       (v & PCIBX_STATUS_DUTASS) ? "DUT asserted"
+						 : "DUT not fully asserted");
+	case CMD_PRINTBOARDID:
+	case CMD_PRINTFIRMREV:
+	case CMD_GETPME:
+		return snprintf(buf, size, "0x%02X", v);
+	case CMD_GLITCH:
+		return snprintf(buf, size, "%s %u: %.3f",
+				glitch_rail_name(s->u.glitch.rail),
+				s->u.glitch.nr, s->u.glitch.width);
+	default:
+		return snprintf(buf, size, "%f", s->u.f);
+	}
+}
 
-	for (i = 0; i < cmdargs.nr_commands; i++) {
-		cmd = &(cmdargs.commands[i]);
+static void ev_begin(const char *cat, const char *name)
+{
+	if (evtrace)
+		evtrace_log(evtrace, 'B', cat, name);
+}
 
-		switch (cmd->id) {
-		case CMD_GLOB:
-			pcibx_cmd_global_pwr(dev, cmd->u.boolean);
-			break;
-		case CMD_UUT:
-			pcibx_cmd_uut_pwr(dev, cmd->u.boolean);
-			break;
-		case CMD_PRINTBOARDID:
-			v = pcibx_cmd_getboardid(dev);
-			print_data("Board ID", "0x%02X", "", v);
-			break;
-		case CMD_PRINTFIRMREV:
-			v = pcibx_cmd_getfirmrev(dev);
-			print_data("Firmware revision", "0x%02X", "", v);
-			break;
-		case CMD_PRINTSTATUS:
-			v = pcibx_cmd_getstatus(dev);
-			print_data("Board status", "%s;  %s;  %s;  %s;  %s", "",
-			       (v & PCIBX_STATUS_RSTDEASS) ? "RST# de-asserted"
-							   : "RST# asserted",
-			       (v & PCIBX_STATUS_64BIT) ? "64-bit operation established"
-							: "No 64-bit handshake detected",
-			       (v & PCIBX_STATUS_32BIT) ? "32-bit operation established"
-							: "No 32-bit handshake detected",
-			       (v & PCIBX_STATUS_MHZ) ? "66 Mhz enabled slot"
-						      : "33 Mhz enabled slot",
-			       (v & PCIBX_STATUS_DUTASS) ? "DUT asserted"
-							 : "DUT not fully asserted");
-			break;
-		case CMD_CLEARBITSTAT:
-			pcibx_cmd_clearbitstat(dev);
-			break;
-		case CMD_AUX5:
-			pcibx_cmd_aux5(dev, cmd->u.boolean);
-			break;
-		case CMD_AUX33:
-			pcibx_cmd_aux33(dev, cmd->u.boolean);
-			break;
-		case CMD_MEASUREFREQ:
-			f = pcibx_cmd_sysfreq(dev);
-			print_data("Measured system frequency", "%f", "Mhz", f);
-			break;
-		case CMD_MEASUREV25REF:
-			f = pcibx_cmd_measure(dev, MEASURE_V25REF);
-			print_data("Measured +2.5V Reference", "%f", "Volt", f);
-			break;
-		case CMD_MEASUREV12UUT:
-			f = pcibx_cmd_measure(dev, MEASURE_V12UUT);
-			print_data("Measured +12V UUT", "%f", "Volt", f);
-			break;
-		case CMD_MEASUREV5UUT:
-			f = pcibx_cmd_measure(dev, MEASURE_V5UUT);
-			print_data("Measured +5V UUT", "%f", "Volt", f);
-			break;
-		case CMD_MEASUREV33UUT:
-			f = pcibx_cmd_measure(dev, MEASURE_V33UUT);
-			print_data("Measured +33V UUT", "%f", "Volt", f);
-			break;
-		case CMD_MEASUREV5AUX:
-			f = pcibx_cmd_measure(dev, MEASURE_V5AUX);
-			print_data("Measured +5V AUX", "%f", "Volt", f);
-			break;
-		case CMD_MEASUREA5:
-			f = pcibx_cmd_measure(dev, MEASURE_A5);
-			print_data("Measured +5V Current", "%f", "Ampere", f);
-			break;
-		case CMD_MEASUREA12:
-			f = pcibx_cmd_measure(dev, MEASURE_A12);
-			print_data("Measured +12V Current", "%f", "Ampere", f);
-			break;
-		case CMD_MEASUREA33:
-			f = pcibx_cmd_measure(dev, MEASURE_A33);
-			print_data("Measured +3.3V Current", "%f", "Ampere", f);
-			break;
-		case CMD_FASTRAMP:
-			pcibx_cmd_ramp(dev, cmd->u.boolean);
-			break;
-		case CMD_RST:
-			pcibx_cmd_rst(dev, cmd->u.d);
-			break;
-		case CMD_RSTDEFAULT:
-			pcibx_cmd_rstdefault(dev);
+static void ev_end(const char *cat, const char *name)
+{
+	if (evtrace)
+		evtrace_log(evtrace, 'E', cat, name);
+}
+
+static void print_sample(const struct sample *s)
+{
+	char value[256];
+
+	ev_begin("output", "print");
+	format_sample_value(value, sizeof(value), s);
+	if (cmdargs.verbose >= 1) {
+		prinfo("%ld.%06ld %s  # ",
+		       (long)s->time.tv_sec, (long)s->time.tv_usec, value);
+	}
+	if (cmdargs.nr_ports > 1)
+		prinfo("%s: ", cmdargs.ports[s->port]);
+	prinfo("%s: %s %s\n", sample_info[s->cmd].description,
+	       value, sample_info[s->cmd].units);
+	ev_end("output", "print");
+}
+
+static struct sample * new_sample(struct worker *w, enum command_id cmd)
+{
+	struct sample *s;
+	struct timeval now, start;
+
+	internal_error_on(w->nr_samples >= MAX_COMMAND);
+	s = &w->samples[w->nr_samples++];
+	s->port = w->index;
+	s->cmd = cmd;
+	gettimeofday(&now, NULL);
+	/* timeval_subtract() modifies its last argument. */
+	start = starttime;
+	if (timeval_subtract(&s->time, &now, &start))
+		prerror("timeval_subtract() went negative!\n");
+
+	return s;
+}
+
+static int sample_is_u8(enum command_id cmd)
+{
+	return (cmd == CMD_PRINTBOARDID ||
+		cmd == CMD_PRINTFIRMREV ||
+		cmd == CMD_PRINTSTATUS ||
+		cmd == CMD_GETPME);
+}
+
+/* Returns 1, if the sample is within the deadband around the
+ * last emitted value of its channel and shall be dropped. */
+static int deadband_suppress(struct worker *w, const struct sample *s)
+{
+	double band = cmdargs.deadband[s->cmd];
+	double value, diff;
+	uint64_t t;
+
+	if (band < 0.0)
+		return 0;
+	value = sample_is_u8(s->cmd) ? s->u.v : s->u.f;
+	t = (uint64_t)s->time.tv_sec * 1000000 + s->time.tv_usec;
+	diff = value - w->deadband[s->cmd].last;
+	if (diff < 0.0)
+		diff = -diff;
+
+	w->deadband[s->cmd].total++;
+	if (w->deadband[s->cmd].valid && diff <= band &&
+	    (!cmdargs.heartbeat ||
+	     t - w->deadband[s->cmd].time < (uint64_t)cmdargs.heartbeat * 1000)) {
+		w->deadband[s->cmd].suppressed++;
+		return 1;
+	}
+	w->deadband[s->cmd].valid = 1;
+	w->deadband[s->cmd].last = value;
+	w->deadband[s->cmd].time = t;
+
+	return 0;
+}
+
+static void record_u8(struct worker *w, enum command_id cmd, uint8_t v)
+{
+	struct sample *s = new_sample(w, cmd);
+
+	s->u.v = v;
+	if (deadband_suppress(w, s))
+		w->nr_samples--;
+}
+
+static void record_float(struct worker *w, enum command_id cmd, float f)
+{
+	struct sample *s = new_sample(w, cmd);
+
+	s->u.f = f;
+	if (deadband_suppress(w, s))
+		w->nr_samples--;
+}
+
+/* The sample is timestamped with the off edge of the pulse. */
+static void record_glitch(void *_w, const struct glitch *g,
+			  unsigned int nr, uint64_t t_off, uint64_t t_on)
+{
+	struct worker *w = _w;
+	struct sample *s = new_sample(w, CMD_GLITCH);
+	uint64_t t, ago;
+
+	t = (uint64_t)s->time.tv_sec * 1000000 + s->time.tv_usec;
+	ago = (monotonic_nsec() - t_off) / 1000;
+	t = (t > ago) ? t - ago : 0;
+	s->time.tv_sec = t / 1000000;
+	s->time.tv_usec = t % 1000000;
+	s->u.glitch.rail = g->rail;
+	s->u.glitch.nr = nr;
+	s->u.glitch.width = (t_on - t_off) / 1000.0;
+}
+
+static int sample_before(const struct sample *a, const struct sample *b)
+{
+	if (a->time.tv_sec != b->time.tv_sec)
+		return a->time.tv_sec < b->time.tv_sec;
+	return a->time.tv_usec < b->time.tv_usec;
+}
+
+/* Merge the sorted sample lists in timestamp order and print them. */
+static void merge_samples(const struct sample *const *lists,
+			  const unsigned int *counts, int nr)
+{
+	unsigned int pos[MAX_PORTS] = { 0, };
+	const struct sample *s, *best;
+	int i, best_list;
+
+	while (1) {
+		best = NULL;
+		best_list = 0;
+		for (i = 0; i < nr; i++) {
+			if (pos[i] >= counts[i])
+				continue;
+			s = &lists[i][pos[i]];
+			if (!best || sample_before(s, best)) {
+				best = s;
+				best_list = i;
+			}
+		}
+		if (!best)
 			break;
-		case CMD_GETPME:
-			v = pcibx_cmd_getpme(dev);
-			print_data("PME# status", "0x%02X", "", v);
+		print_sample(best);
+		pos[best_list]++;
+	}
+}
+
+/* Hand the samples to the output thread. The acquisition
+ * only copies them, merging is done by the output thread. */
+static void queue_samples(void)
+{
+	struct sample end = { .cmd = NR_COMMAND_IDS, };
+	struct worker *w;
+	unsigned int j;
+	int i;
+
+	for (i = 0; i < cmdargs.nr_ports; i++) {
+		w = &workers[i];
+		for (j = 0; j < w->nr_samples; j++) {
+			if (spsc_push(output_ring, &w->samples[j])) {
+				__atomic_add_fetch(&output_dropped, 1,
+						   __ATOMIC_RELAXED);
+			}
+		}
+	}
+	/* If the end marker is dropped, the output thread
+	 * merges this cycle together with the next one. */
+	spsc_push(output_ring, &end);
+
+	pthread_mutex_lock(&output_mutex);
+	output_pending = 1;
+	pthread_cond_signal(&output_cond);
+	pthread_mutex_unlock(&output_mutex);
+}
+
+static void flush_samples(void)
+{
+	const struct sample *lists[MAX_PORTS];
+	unsigned int counts[MAX_PORTS];
+	int i;
+
+	if (output_ring) {
+		queue_samples();
+	} else {
+		for (i = 0; i < cmdargs.nr_ports; i++) {
+			lists[i] = workers[i].samples;
+			counts[i] = workers[i].nr_samples;
+		}
+		merge_samples(lists, counts, cmdargs.nr_ports);
+	}
+	for (i = 0; i < cmdargs.nr_ports; i++)
+		workers[i].nr_samples = 0;
+}
+
+/* Merge and print a cycle of queued samples. The samples of each
+ * worker are consecutive and sorted, so every run of one port is
+ * a sorted list. */
+static void print_batch(const struct sample *batch, unsigned int n)
+{
+	const struct sample *lists[MAX_PORTS];
+	unsigned int counts[MAX_PORTS];
+	unsigned int j;
+	int nr = 0;
+
+	for (j = 0; j < n; j++) {
+		if (nr && batch[j].port == lists[nr - 1]->port) {
+			counts[nr - 1]++;
+			continue;
+		}
+		if (nr == MAX_PORTS) {
+			/* Lost end markers joined too many cycles. */
+			merge_samples(lists, counts, nr);
+			nr = 0;
+		}
+		lists[nr] = &batch[j];
+		counts[nr] = 1;
+		nr++;
+	}
+	merge_samples(lists, counts, nr);
+}
+
+/* Print the queued samples, so that a slow stdout
+ * does not delay the acquisition. */
+static void * output_thread(void *unused)
+{
+	const unsigned int size = MAX_PORTS * MAX_COMMAND;
+	unsigned long dropped, reported = 0;
+	struct sample *batch, s;
+	unsigned int n = 0;
+	int stop, printed;
+
+	batch = malloce(sizeof(*batch) * size);
+	while (1) {
+		pthread_mutex_lock(&output_mutex);
+		while (!output_pending && !stop_output)
+			pthread_cond_wait(&output_cond, &output_mutex);
+		output_pending = 0;
+		/* Check for stop before draining, so that nothing
+		 * pushed before the stop request is lost. */
+		stop = stop_output;
+		pthread_mutex_unlock(&output_mutex);
+
+		printed = 0;
+		while (spsc_pop(output_ring, &s) == 0) {
+			if (s.cmd != NR_COMMAND_IDS)
+				batch[n++] = s;
+			if (s.cmd == NR_COMMAND_IDS || n == size) {
+				print_batch(batch, n);
+				n = 0;
+				printed = 1;
+			}
+		}
+		if (stop && n) {
+			print_batch(batch, n);
+			printed = 1;
+		}
+		if (printed)
+			fflush(stdout);
+		dropped = __atomic_load_n(&output_dropped, __ATOMIC_RELAXED);
+		if (dropped != reported) {
+			prerror("Output queue overflow: %lu samples dropped\n",
+				dropped - reported);
+			reported = dropped;
+		}
+		if (stop)
 			break;
-		default:
-			internal_error("invalid command");
+	}
+	free(batch);
+
+	return NULL;
+}
+
+static void start_output_thread(void)
+{
+	int err;
+
+	output_ring = spsc_create(cmdargs.async_output, sizeof(struct sample));
+	err = pthread_create(&output_thread_id, NULL, output_thread, NULL);
+	if (err) {
+		prerror("Could not create output thread: %s\n", strerror(err));
+		internal_error("output thread creation");
+	}
+}
+
+static void stop_output_thread(void)
+{
+	pthread_mutex_lock(&output_mutex);
+	stop_output = 1;
+	pthread_cond_signal(&output_cond);
+	pthread_mutex_unlock(&output_mutex);
+	pthread_join(output_thread_id, NULL);
+	if (output_dropped) {
+		prerror("Output queue overflow: %lu samples dropped in total\n",
+			output_dropped);
+	}
+	spsc_destroy(output_ring);
+	output_ring = NULL;
+}
+
+static void measure(struct worker *w, enum command_id cmd,
+		    enum measure_id id)
+{
+	uint64_t now;
+	float f;
+
+	if (w->raw) {
+		/* Store the code. It is converted offline. */
+		rawlog_write(w->raw, id, pcibx_cmd_measure_raw(&w->dev, id));
+		return;
+	}
+	f = pcibx_cmd_measure(&w->dev, id);
+	telemetry_update_measure(w->telemetry, id, f);
+	if (w->energy || w->segment) {
+		now = monotonic_nsec();
+		if (w->energy)
+			energy_sample(w->energy, id, f, now);
+		if (w->segment)
+			segment_sample(w->segment, id, f, now);
+	}
+	record_float(w, cmd, f);
+}
+
+static int send_command(struct worker *w, const struct pcibx_command *cmd)
+{
+	struct pcibx_device *dev = &w->dev;
+	uint64_t t0 = 0;
+	uint8_t v;
+	float f;
+
+	if (w->latency)
+		t0 = monotonic_nsec();
+	ev_begin("command", command_names[cmd->id]);
+
+	switch (cmd->id) {
+	case CMD_GLOB:
+		pcibx_cmd_global_pwr(dev, cmd->u.boolean);
+		break;
+	case CMD_UUT:
+		pcibx_cmd_uut_pwr(dev, cmd->u.boolean);
+		break;
+	case CMD_PRINTBOARDID:
+		v = pcibx_cmd_getboardid(dev);
+		record_u8(w, cmd->id, v);
+		break;
+	case CMD_PRINTFIRMREV:
+		v = pcibx_cmd_getfirmrev(dev);
+		record_u8(w, cmd->id, v);
+		break;
+	case CMD_PRINTSTATUS:
+		v = pcibx_cmd_getstatus(dev);
+		telemetry_update_status(w->telemetry, v);
+		record_u8(w, cmd->id, v);
+		break;
+	case CMD_CLEARBITSTAT:
+		pcibx_cmd_clearbitstat(dev);
+		break;
+	case CMD_AUX5:
+		pcibx_cmd_aux5(dev, cmd->u.boolean);
+		break;
+	case CMD_AUX33:
+		pcibx_cmd_aux33(dev, cmd->u.boolean);
+		break;
+	case CMD_MEASUREFREQ:
+		f = pcibx_cmd_sysfreq(dev);
+		telemetry_update_sysfreq(w->telemetry, f);
+		record_float(w, cmd->id, f);
+		break;
+	case CMD_MEASUREV25REF:
+		measure(w, cmd->id, MEASURE_V25REF);
+		break;
+	case CMD_MEASUREV12UUT:
+		measure(w, cmd->id, MEASURE_V12UUT);
+		break;
+	case CMD_MEASUREV5UUT:
+		measure(w, cmd->id, MEASURE_V5UUT);
+		break;
+	case CMD_MEASUREV33UUT:
+		measure(w, cmd->id, MEASURE_V33UUT);
+		break;
+	case CMD_MEASUREV5AUX:
+		measure(w, cmd->id, MEASURE_V5AUX);
+		break;
+	case CMD_MEASUREA5:
+		measure(w, cmd->id, MEASURE_A5);
+		break;
+	case CMD_MEASUREA12:
+		measure(w, cmd->id, MEASURE_A12);
+		break;
+	case CMD_MEASUREA33:
+		measure(w, cmd->id, MEASURE_A33);
+		break;
+	case CMD_FASTRAMP:
+		pcibx_cmd_ramp(dev, cmd->u.boolean);
+		break;
+	case CMD_RST:
+		pcibx_cmd_rst(dev, cmd->u.d);
+		break;
+	case CMD_RSTDEFAULT:
+		pcibx_cmd_rstdefault(dev);
+		break;
+	case CMD_GETPME:
+		v = pcibx_cmd_getpme(dev);
+		telemetry_update_pme(w->telemetry, v);
+		record_u8(w, cmd->id, v);
+		break;
+	case CMD_PHASE:
+		if (w->energy && energy_set_phase(w->energy, cmd->u.str)) {
+			ev_end("command", command_names[cmd->id]);
 			return -1;
 		}
+		break;
+	case CMD_GLITCH:
+		glitch_run(dev, cmd->u.glitch, record_glitch, w);
+		break;
+	default:
+		internal_error("invalid command");
+		return -1;
+	}
+	ev_end("command", command_names[cmd->id]);
+	if (w->latency) {
+		histogram_add(&w->latency[cmd->id],
+			      (monotonic_nsec() - t0) / 1000);
+	}
+	metrics_poll(w->metrics, w->telemetry, dev);
+
+	return 0;
+}
+
+static int send_commands(struct worker *w)
+{
+	int i, err;
+
+	for (i = 0; i < cmdargs.nr_commands; i++) {
+		err = send_command(w, &cmdargs.commands[i]);
+		if (err)
+			return err;
 	}
 	if (cmdargs.verbose >= 2)
 		prinfo("All commands sent.\n");
@@ -201,6 +687,154 @@ static int send_commands(struct pcibx_device *dev)
 	return 0;
 }
 
+/* Assumed duration of one parport register access.
+ * The protocol delays dominate anyway. */
+#define ESTIMATE_BUS_CYCLE_NSEC	1000
+
+static double estimate_msec(unsigned long bus_cycles, uint64_t delay_usec)
+{
+	return (bus_cycles * (double)ESTIMATE_BUS_CYCLE_NSEC / 1000.0 +
+		delay_usec) / 1000.0;
+}
+
+/* Run one cycle of the command list on the estimate backend.
+ * Returns the bus cycles and the delay in *cycles and *usec. */
+static int estimate_cycle(struct worker *w, int print,
+			  unsigned long *cycles, uint64_t *usec)
+{
+	unsigned long c0 = w->dev.bus_cycles;
+	uint64_t d0 = w->dev.delay_usec;
+	unsigned long c;
+	uint64_t d;
+	int i, err;
+
+	for (i = 0; i < cmdargs.nr_commands; i++) {
+		c = w->dev.bus_cycles;
+		d = w->dev.delay_usec;
+		err = send_command(w, &cmdargs.commands[i]);
+		if (err)
+			return err;
+		w->nr_samples = 0;
+		if (print) {
+			c = w->dev.bus_cycles - c;
+			d = w->dev.delay_usec - d;
+			prinfo("  %-16s %10lu %12.3f\n",
+			       command_names[cmdargs.commands[i].id],
+			       c, estimate_msec(c, d));
+		}
+	}
+	*cycles = w->dev.bus_cycles - c0;
+	*usec = w->dev.delay_usec - d0;
+
+	return 0;
+}
+
+/* --estimate: Walk the command list without touching the port
+ * and print the expected bus cycles and wall time. */
+static int run_estimate(void)
+{
+	struct worker *w;
+	unsigned long first_cycles, cycles;
+	uint64_t first_usec, usec;
+	double first, next, total;
+	int err;
+
+	w = malloce(sizeof(*w));
+	memset(w, 0, sizeof(*w));
+	err = pcibx_device_init(&w->dev, cmdargs.ports[0], cmdargs.is_PCI_1,
+				&pcibx_backend_estimate);
+	if (err)
+		goto out;
+	if (cmdargs.timing_file) {
+		/* There is no board to check. */
+		err = timing_load(&w->dev, cmdargs.timing_file, 0);
+		if (err)
+			goto out_exit;
+	}
+
+	prinfo("Estimated timing of the first cycle:\n");
+	prinfo("  %-16s %10s %12s\n", "Command", "Bus cycles", "Time [msec]");
+	err = estimate_cycle(w, 1, &first_cycles, &first_usec);
+	if (err)
+		goto out_exit;
+	/* The following cycles start with the multiplexer and the
+	 * control register in the state the first cycle left them. */
+	err = estimate_cycle(w, 0, &cycles, &usec);
+	if (err)
+		goto out_exit;
+	first = estimate_msec(first_cycles, first_usec);
+	next = estimate_msec(cycles, usec);
+
+	prinfo("First cycle:      %lu bus cycles, %.3f msec\n", first_cycles, first);
+	prinfo("Following cycles: %lu bus cycles, %.3f msec + %d msec delay\n",
+	       cycles, next, cmdargs.cycle_delay);
+	if (cmdargs.nrcycle > 0) {
+		total = first + (cmdargs.nrcycle - 1) * (next + cmdargs.cycle_delay);
+		prinfo("Total (%d cycles): %lu bus cycles, %.3f sec\n",
+		       cmdargs.nrcycle,
+		       first_cycles + (cmdargs.nrcycle - 1) * cycles,
+		       total / 1000.0);
+	} else {
+		prinfo("Cycle rate: %.3f cycles/sec\n",
+		       1000.0 / (next + cmdargs.cycle_delay));
+	}
+	prinfo("(Assuming %d nsec per bus cycle and immediate RST# de-assertion)\n",
+	       ESTIMATE_BUS_CYCLE_NSEC);
+
+out_exit:
+	pcibx_device_exit(&w->dev);
+out:
+	free(w);
+
+	return err;
+}
+
+static void dump_sample(const char *name,
+			const struct pcibx_telemetry_sample *s,
+			uint64_t now, int hex)
+{
+	if (!s->count) {
+		prinfo("%-8s  -\n", name);
+		return;
+	}
+	if (hex)
+		prinfo("%-8s  0x%02X", name, (unsigned int)s->value);
+	else
+		prinfo("%-8s  %f", name, s->value);
+	prinfo("  (#%u, %.6f sec ago)\n",
+	       s->count, (double)(now - s->time) / 1000000000.0);
+}
+
+static int dump_telemetry(const char *name)
+{
+	const struct pcibx_telemetry *t;
+	struct pcibx_telemetry snap;
+	uint64_t now;
+	int i, err;
+
+	t = telemetry_attach(name);
+	if (!t)
+		return -1;
+	err = telemetry_snapshot(t, &snap);
+	now = monotonic_nsec();
+	telemetry_detach(t);
+	if (err) {
+		prerror("Could not get a consistent telemetry snapshot\n");
+		return -1;
+	}
+
+	prinfo("Telemetry of pcibx PID %u (update #%u)\n",
+	       snap.pid, snap.seq / 2);
+	for (i = 0; i < PCIBX_NR_MEASURE; i++)
+		dump_sample(pcibx_measure_name(i + MEASURE_V25REF),
+			    &snap.measure[i], now, 0);
+	dump_sample("sysfreq", &snap.sysfreq, now, 0);
+	dump_sample("status", &snap.status, now, 1);
+	dump_sample("pme", &snap.pme, now, 1);
+
+	return 0;
+}
+
 static int request_priority(void)
 {
 	struct sched_param param;
@@ -233,10 +867,76 @@ static void print_usage(int argc, char **argv)
 	prinfo("  -h|--help             Print this help\n");
 	prinfo("\n");
 	prinfo("  -p|--port /dev/parportX  Parport device (Default: /dev/parport0)\n");
+	prinfo("                        May be given multiple times to drive several extenders\n");
+	prinfo("  -b|--backend NAME     Port access: ppdev (default), direct (PORT is the I/O base, e.g. 0x378)\n");
+	prinfo("                        replay (PORT is a bus trace file) or sim (a simulated\n");
+	prinfo("                        board, for testing without hardware)\n");
+	prinfo("  --trace-record FILE   Record all bus transactions to FILE\n");
+	prinfo("  --event-trace FILE    Record the timeline of the commands, bus transactions,\n");
+	prinfo("                        delays and output and write it to FILE at exit\n");
+	prinfo("                        (Chrome trace JSON, open with chrome://tracing or Perfetto)\n");
+	prinfo("  --event-trace-size N  Max number of --event-trace events (default: 1048576)\n");
 	prinfo("  -P|--pci1 BOOL        If true, PCI_1 (default), otherwise PCI_2. (See JP15)\n");
 	prinfo("  -s|--sched POLICY     Scheduling policy (normal, fifo, rr)\n");
 	prinfo("  -n|--nrcycle COUNT    Cycle COUNT times. 0 = infinite (default: 1)\n");
 	prinfo("  -d|--delay DELAY      DELAY msecs after each cycle. Default 0\n");
+	prinfo("  --shm NAME            Publish the latest samples in shared memory segment NAME\n");
+	prinfo("  --shm-read NAME       Print the samples published in segment NAME and exit\n");
+	prinfo("  --metrics FILE        Export the latest samples to FILE (Prometheus text format)\n");
+	prinfo("  --metrics-interval MSEC  Metrics FILE update interval (default: 1000)\n");
+	prinfo("  --deadband [CH=]VALUE Only print CH (or all measurements), if it changed by more than VALUE\n");
+	prinfo("                        CH: v25ref, v12uut, v5uut, v33uut, v5aux, a5, a12, a33, freq, status, pme\n");
+	prinfo("  --heartbeat MSEC      With --deadband, print unchanged values every MSEC anyway\n");
+	prinfo("  --energy              Integrate the energy per rail and print it at exit\n");
+	prinfo("  --segment WATT        Split the measurements into segments of constant UUT power\n");
+	prinfo("                        and print them. WATT is the smallest change to detect.\n");
+	prinfo("  --latency             Print per command latency percentiles at exit\n");
+	prinfo("  --latency-file FILE   Also write the latency percentiles to FILE\n");
+	prinfo("  --shared              Share the port with other pcibx processes. The port is only\n");
+	prinfo("                        claimed while a device command runs. The processes\n");
+	prinfo("                        lock /run/lock/pcibx-PORT.lock (mode 0660)\n");
+	prinfo("  --timing FILE         Use the strobe widths stored in FILE by --probe-timing\n");
+	prinfo("  --raw FILE            Store the raw ADC codes of the measurements in FILE,\n");
+	prinfo("                        instead of converting and printing them\n");
+	prinfo("  --convert FILE        Convert and print the --raw FILE and exit\n");
+	prinfo("  --estimate            Print the expected bus cycles and time of the device\n");
+	prinfo("                        commands (with -n and -d), without accessing the port\n");
+	prinfo("  --async-output SIZE   Print the samples from a separate thread, queueing up to\n");
+	prinfo("                        SIZE samples. Samples are dropped, if the queue is full.\n");
+	prinfo("  --reorder             The order of the device commands does not matter.\n");
+	prinfo("                        Group the reads by channel and drop duplicate commands.\n");
+	prinfo("                        Power, AUX, RAMP, RST# and phase commands are not reordered.\n");
+	prinfo("\n");
+	prinfo("Modes\n");
+	prinfo("  --stress CYCLES       Power cycle the UUT CYCLES times and print statistics\n");
+	prinfo("  --stress-off MSEC     UUT OFF time per cycle (default: 1000)\n");
+	prinfo("  --stress-on MSEC      UUT ON time per cycle (default: 1000)\n");
+	prinfo("  --stress-timeout MSEC Max time to RST# de-assertion (default: 5000)\n");
+	prinfo("  --stress-channel CH   Current channel for the peak current (a5, a12, a33, none)\n");
+	prinfo("  --wd-limit CH>VALUE   Cut the UUT power, if CH is above (>) or below (<) VALUE\n");
+	prinfo("                        May be given multiple times. The first limit is sampled\n");
+	prinfo("                        continuously, the others less often (see --wd-ratio).\n");
+	prinfo("                        The device commands are sent once, before arming.\n");
+	prinfo("  --clock SEC           Measure the system frequency continuously for SEC seconds\n");
+	prinfo("                        (0 = until interrupted) and print its stability\n");
+	prinfo("  --clock-tau LIST      Comma separated Allan deviation tau values in seconds\n");
+	prinfo("                        (default: 0.1,1,10)\n");
+	prinfo("  --probe-timing FILE   Find the shortest working strobe widths of the board\n");
+	prinfo("                        and store them (with margin) in FILE.\n");
+	prinfo("                        The UUT must be switched off.\n");
+	prinfo("  --probe-margin PCT    Margin added to the probed strobe widths (default: 100)\n");
+	prinfo("  --inrush CH           Power on the UUT and capture the current CH (a5, a12, a33)\n");
+	prinfo("                        until RST# is de-asserted\n");
+	prinfo("  --inrush-off MSEC     UUT OFF time before the power on (default: 1000)\n");
+	prinfo("  --inrush-timeout MSEC Max capture time (default: 5000)\n");
+	prinfo("  --wd-ratio N          Check the other limits every N samples (default: 10)\n");
+	prinfo("  --rate CH=MSEC        Read CH (see --deadband) every MSEC, earliest deadline first,\n");
+	prinfo("                        and print the achieved rates. May be given multiple times.\n");
+	prinfo("                        The device commands are sent once, before the schedule.\n");
+	prinfo("  --rate-time SEC       Run the --rate schedule for SEC seconds (default: 0 = until\n");
+	prinfo("                        interrupted)\n");
+	prinfo("  --edges SEC           Poll the status and PME# for SEC seconds (0 = until\n");
+	prinfo("                        interrupted) and print every edge with its timestamp\n");
 	prinfo("\n");
 	prinfo("Device commands\n");
 	prinfo("  --cmd-glob ON/OFF     Turn Global power ON/OFF (does not turn ON UUT Voltages)\n");
@@ -259,6 +959,14 @@ static void print_usage(int argc, char **argv)
 	prinfo("  --cmd-fastramp ON/OFF Select slow/fast +5V ramp\n");
 	prinfo("  --cmd-rst 0.150       Set RST# (reset) delay (in seconds)\n");
 	prinfo("  --cmd-rstdefault      Set RST# to default (150msec)\n");
+	prinfo("  --cmd-getpme          Print the PME# status\n");
+	prinfo("  --cmd-phase NAME      Start the energy accounting phase NAME\n");
+	prinfo("  --cmd-glitch RAIL:WIDTH[:COUNT:PERIOD]\n");
+	prinfo("                        Switch RAIL (uut, aux5, aux33) off for WIDTH, COUNT\n");
+	prinfo("                        times every PERIOD, and print the achieved widths,\n");
+	prinfo("                        timestamped with the off edge (see -V 1). A rail that\n");
+	prinfo("                        was off is switched off again afterwards.\n");
+	prinfo("                        Durations in usec or with us/ms/s suffix\n");
 }
 
 #define ARG_MATCH		0
@@ -431,70 +1139,287 @@ error:
 	return -1;
 }
 
-static int add_command(enum command_id cmd)
+static const struct {
+	const char *name;
+	enum command_id cmd;
+} channel_names[] = {
+	{ "v25ref",	CMD_MEASUREV25REF, },
+	{ "v12uut",	CMD_MEASUREV12UUT, },
+	{ "v5uut",	CMD_MEASUREV5UUT, },
+	{ "v33uut",	CMD_MEASUREV33UUT, },
+	{ "v5aux",	CMD_MEASUREV5AUX, },
+	{ "a5",		CMD_MEASUREA5, },
+	{ "a12",	CMD_MEASUREA12, },
+	{ "a33",	CMD_MEASUREA33, },
+	{ "freq",	CMD_MEASUREFREQ, },
+	{ "status",	CMD_PRINTSTATUS, },
+	{ "pme",	CMD_GETPME, },
+};
+
+/* Parse "VALUE" (all measurements) or "CHANNEL=VALUE". */
+static int parse_deadband(const char *str)
 {
-	if (cmdargs.nr_commands == MAX_COMMAND) {
-		prerror("Maximum number of commands exceed.\n");
+	const char *eq;
+	double value;
+	size_t len;
+	int i, err;
+
+	eq = strchr(str, '=');
+	err = parse_double(eq ? eq + 1 : str, &value, "--deadband");
+	if (err)
+		return err;
+	if (value < 0.0) {
+		prerror("--deadband VALUE must not be negative\n");
 		return -1;
 	}
-	cmdargs.commands[cmdargs.nr_commands++].id = cmd;
+	if (!eq) {
+		for (i = 0; i < ARRAY_SIZE(channel_names); i++) {
+			if (!sample_is_u8(channel_names[i].cmd))
+				cmdargs.deadband[channel_names[i].cmd] = value;
+		}
+		return 0;
+	}
+	len = eq - str;
+	for (i = 0; i < ARRAY_SIZE(channel_names); i++) {
+		if (strlen(channel_names[i].name) == len &&
+		    strncasecmp(channel_names[i].name, str, len) == 0) {
+			cmdargs.deadband[channel_names[i].cmd] = value;
+			return 0;
+		}
+	}
+	prerror("Invalid channel in --deadband %s\n", str);
 
-	return 0;
+	return -1;
 }
 
-static int add_boolcommand(enum command_id cmd,
-			   const char *str,
-			   const char *param)
+/* Parse "CHANNEL=MSEC". */
+static int parse_rate(const char *str)
 {
-	int boolean;
+	const char *eq;
+	double value;
+	size_t len;
+	int i, err;
 
-	if (cmdargs.nr_commands == MAX_COMMAND) {
-		prerror("Maximum number of commands exceed.\n");
+	eq = strchr(str, '=');
+	if (!eq)
+		goto error;
+	err = parse_double(eq + 1, &value, "--rate");
+	if (err)
+		return err;
+	if (value <= 0.0) {
+		prerror("--rate MSEC must be positive\n");
 		return -1;
 	}
+	len = eq - str;
+	for (i = 0; i < ARRAY_SIZE(channel_names); i++) {
+		if (strlen(channel_names[i].name) == len &&
+		    strncasecmp(channel_names[i].name, str, len) == 0) {
+			if (cmdargs.rate[channel_names[i].cmd] == 0.0)
+				cmdargs.nr_rates++;
+			cmdargs.rate[channel_names[i].cmd] = value;
+			return 0;
+		}
+	}
+error:
+	prerror("Invalid parameter to --rate: %s\n", str);
 
-	boolean = parse_bool(str, param);
-	if (boolean < 0)
-		return -1;
-	cmdargs.commands[cmdargs.nr_commands].id = cmd;
-	cmdargs.commands[cmdargs.nr_commands].u.boolean = !!boolean;
-	cmdargs.nr_commands++;
-
-	return 0;
+	return -1;
 }
 
-static int add_doublecommand(enum command_id cmd,
-			     const char *str,
-			     const char *param)
+static int parse_wd_limit(const char *str)
 {
-	int err;
+	struct wd_limit *limit;
+	char name[16];
+	const char *op;
 	double value;
+	size_t len;
+	int err;
 
-	if (cmdargs.nr_commands == MAX_COMMAND) {
-		prerror("Maximum number of commands exceed.\n");
+	if (cmdargs.nr_wd_limits == MAX_WD_LIMITS) {
+		prerror("Maximum number of --wd-limit exceeded.\n");
 		return -1;
 	}
+	limit = &cmdargs.wd_limits[cmdargs.nr_wd_limits];
 
-	err = parse_double(str, &value, param);
+	op = strpbrk(str, "<>");
+	if (!op)
+		goto error;
+	len = op - str;
+	if (len >= sizeof(name))
+		goto error;
+	memcpy(name, str, len);
+	name[len] = '\0';
+	limit->channel = pcibx_measure_find(name);
+	if (limit->channel < 0)
+		goto error;
+	limit->above = (*op == '>');
+	err = parse_double(op + 1, &value, "--wd-limit");
 	if (err)
 		return err;
-	cmdargs.commands[cmdargs.nr_commands].id = cmd;
-	cmdargs.commands[cmdargs.nr_commands].u.d = value;
-	cmdargs.nr_commands++;
+	limit->value = value;
+	cmdargs.nr_wd_limits++;
 
 	return 0;
+error:
+	prerror("Invalid parameter to --wd-limit: %s\n", str);
+	return -1;
 }
 
-static int parse_args(int argc, char **argv)
+static int parse_clock_tau(const char *str)
 {
-	int i, err;
-	char *param;
-
-	cmdargs.port = "/dev/parport0";
-	cmdargs.is_PCI_1 = 1;
+	char *list, *tok, *save = NULL;
+	double tau;
+	int err = 0;
+
+	list = strdup(str);
+	cmdargs.nr_clock_tau = 0;
+	for (tok = strtok_r(list, ",", &save); tok;
+	     tok = strtok_r(NULL, ",", &save)) {
+		if (cmdargs.nr_clock_tau == MAX_CLOCK_TAU) {
+			prerror("Too many --clock-tau values\n");
+			err = -1;
+			break;
+		}
+		err = parse_double(tok, &tau, "--clock-tau");
+		if (err)
+			break;
+		if (tau <= 0.0) {
+			prerror("--clock-tau values must be positive\n");
+			err = -1;
+			break;
+		}
+		cmdargs.clock_tau[cmdargs.nr_clock_tau++] = tau;
+	}
+	free(list);
+
+	return err;
+}
+
+static int add_command(enum command_id cmd)
+{
+	if (cmdargs.nr_commands == MAX_COMMAND) {
+		prerror("Maximum number of commands exceed.\n");
+		return -1;
+	}
+	cmdargs.commands[cmdargs.nr_commands++].id = cmd;
+
+	return 0;
+}
+
+static int add_boolcommand(enum command_id cmd,
+			   const char *str,
+			   const char *param)
+{
+	int boolean;
+
+	if (cmdargs.nr_commands == MAX_COMMAND) {
+		prerror("Maximum number of commands exceed.\n");
+		return -1;
+	}
+
+	boolean = parse_bool(str, param);
+	if (boolean < 0)
+		return -1;
+	cmdargs.commands[cmdargs.nr_commands].id = cmd;
+	cmdargs.commands[cmdargs.nr_commands].u.boolean = !!boolean;
+	cmdargs.nr_commands++;
+
+	return 0;
+}
+
+static int add_doublecommand(enum command_id cmd,
+			     const char *str,
+			     const char *param)
+{
+	int err;
+	double value;
+
+	if (cmdargs.nr_commands == MAX_COMMAND) {
+		prerror("Maximum number of commands exceed.\n");
+		return -1;
+	}
+
+	err = parse_double(str, &value, param);
+	if (err)
+		return err;
+	cmdargs.commands[cmdargs.nr_commands].id = cmd;
+	cmdargs.commands[cmdargs.nr_commands].u.d = value;
+	cmdargs.nr_commands++;
+
+	return 0;
+}
+
+static int add_strcommand(enum command_id cmd,
+			  const char *str)
+{
+	if (cmdargs.nr_commands == MAX_COMMAND) {
+		prerror("Maximum number of commands exceed.\n");
+		return -1;
+	}
+
+	cmdargs.commands[cmdargs.nr_commands].id = cmd;
+	cmdargs.commands[cmdargs.nr_commands].u.str = str;
+	cmdargs.nr_commands++;
+
+	return 0;
+}
+
+static int add_glitchcommand(const char *str)
+{
+	struct glitch *g;
+
+	if (cmdargs.nr_commands == MAX_COMMAND) {
+		prerror("Maximum number of commands exceed.\n");
+		return -1;
+	}
+
+	g = glitch_parse(str);
+	if (!g)
+		return -1;
+	cmdargs.commands[cmdargs.nr_commands].id = CMD_GLITCH;
+	cmdargs.commands[cmdargs.nr_commands].u.glitch = g;
+	cmdargs.nr_commands++;
+
+	return 0;
+}
+
+static void free_commands(void)
+{
+	int i;
+
+	for (i = 0; i < cmdargs.nr_commands; i++) {
+		if (cmdargs.commands[i].id == CMD_GLITCH)
+			free((void *)cmdargs.commands[i].u.glitch);
+	}
+	cmdargs.nr_commands = 0;
+}
+
+static int parse_args(int argc, char **argv)
+{
+	int i, err;
+	char *param;
+
+	cmdargs.is_PCI_1 = 1;
 	cmdargs.sched = SCHED_OTHER;
 	cmdargs.cycle_delay = 0;
 	cmdargs.nrcycle = 1;
+	cmdargs.metrics_interval = 1000;
+	cmdargs.evtrace_size = 1048576;
+	for (i = 0; i < NR_COMMAND_IDS; i++)
+		cmdargs.deadband[i] = -1.0;
+	cmdargs.stress_off = 1000;
+	cmdargs.stress_on = 1000;
+	cmdargs.stress_timeout = 5000;
+	cmdargs.stress_channel = MEASURE_A5;
+	cmdargs.wd_ratio = 10;
+	cmdargs.probe_margin = 100;
+	cmdargs.inrush_channel = -1;
+	cmdargs.inrush_off = 1000;
+	cmdargs.inrush_timeout = 5000;
+	cmdargs.clock_tau[0] = 0.1;
+	cmdargs.clock_tau[1] = 1.0;
+	cmdargs.clock_tau[2] = 10.0;
+	cmdargs.nr_clock_tau = 3;
 
 	for (i = 1; i < argc; i++) {
 		if (arg_match(argv, &i, "--version", "-v", 0)) {
@@ -509,7 +1434,29 @@ static int parse_args(int argc, char **argv)
 			if (err)
 				goto error;
 		} else if (arg_match(argv, &i, "--port", "-p", &param)) {
-			cmdargs.port = param;
+			if (cmdargs.nr_ports == MAX_PORTS) {
+				prerror("Maximum number of ports exceed.\n");
+				goto error;
+			}
+			cmdargs.ports[cmdargs.nr_ports++] = param;
+		} else if (arg_match(argv, &i, "--backend", "-b", &param)) {
+			cmdargs.backend = pcibx_backend_find(param);
+			if (!cmdargs.backend) {
+				prerror("Invalid parameter to --backend\n");
+				goto error;
+			}
+		} else if (arg_match(argv, &i, "--trace-record", 0, &param)) {
+			cmdargs.trace_file = param;
+		} else if (arg_match(argv, &i, "--event-trace", 0, &param)) {
+			cmdargs.evtrace_file = param;
+		} else if (arg_match(argv, &i, "--event-trace-size", 0, &param)) {
+			err = parse_int(param, &cmdargs.evtrace_size, "--event-trace-size");
+			if (err)
+				goto error;
+			if (cmdargs.evtrace_size <= 0) {
+				prerror("--event-trace-size must be positive\n");
+				goto error;
+			}
 		} else if (arg_match(argv, &i, "--pci1", "-P", &param)) {
 			err = parse_bool(param, "--pci1");
 			if (err < 0)
@@ -534,6 +1481,180 @@ static int parse_args(int argc, char **argv)
 			err = parse_int(param, &cmdargs.nrcycle, "--nrcycle");
 			if (err)
 				goto error;
+		} else if (arg_match(argv, &i, "--shm", 0, &param)) {
+			cmdargs.shm_name = param;
+		} else if (arg_match(argv, &i, "--shm-read", 0, &param)) {
+			cmdargs.shm_read = param;
+		} else if (arg_match(argv, &i, "--metrics", 0, &param)) {
+			cmdargs.metrics_file = param;
+		} else if (arg_match(argv, &i, "--metrics-interval", 0, &param)) {
+			err = parse_int(param, &cmdargs.metrics_interval, "--metrics-interval");
+			if (err)
+				goto error;
+		} else if (arg_match(argv, &i, "--deadband", 0, &param)) {
+			err = parse_deadband(param);
+			if (err)
+				goto error;
+		} else if (arg_match(argv, &i, "--heartbeat", 0, &param)) {
+			err = parse_int(param, &cmdargs.heartbeat, "--heartbeat");
+			if (err)
+				goto error;
+		} else if (arg_match(argv, &i, "--energy", 0, 0)) {
+			cmdargs.energy = 1;
+		} else if (arg_match(argv, &i, "--segment", 0, &param)) {
+			err = parse_double(param, &cmdargs.segment, "--segment");
+			if (err)
+				goto error;
+			if (cmdargs.segment <= 0.0) {
+				prerror("--segment WATT must be positive\n");
+				goto error;
+			}
+		} else if (arg_match(argv, &i, "--latency", 0, 0)) {
+			cmdargs.latency = 1;
+		} else if (arg_match(argv, &i, "--latency-file", 0, &param)) {
+			cmdargs.latency_file = param;
+		} else if (arg_match(argv, &i, "--shared", 0, 0)) {
+			cmdargs.shared = 1;
+		} else if (arg_match(argv, &i, "--timing", 0, &param)) {
+			cmdargs.timing_file = param;
+		} else if (arg_match(argv, &i, "--probe-timing", 0, &param)) {
+			cmdargs.probe_file = param;
+		} else if (arg_match(argv, &i, "--probe-margin", 0, &param)) {
+			err = parse_int(param, &cmdargs.probe_margin, "--probe-margin");
+			if (err)
+				goto error;
+			if (cmdargs.probe_margin < 0) {
+				prerror("--probe-margin must not be negative\n");
+				goto error;
+			}
+		} else if (arg_match(argv, &i, "--raw", 0, &param)) {
+			cmdargs.raw_file = param;
+		} else if (arg_match(argv, &i, "--convert", 0, &param)) {
+			cmdargs.convert_file = param;
+		} else if (arg_match(argv, &i, "--estimate", 0, 0)) {
+			cmdargs.estimate = 1;
+		} else if (arg_match(argv, &i, "--async-output", 0, &param)) {
+			err = parse_int(param, &cmdargs.async_output, "--async-output");
+			if (err)
+				goto error;
+			if (cmdargs.async_output < 1) {
+				prerror("--async-output SIZE must be at least 1\n");
+				goto error;
+			}
+		} else if (arg_match(argv, &i, "--reorder", 0, 0)) {
+			cmdargs.reorder = 1;
+		} else if (arg_match(argv, &i, "--stress", 0, &param)) {
+			err = parse_int(param, &cmdargs.stress_cycles, "--stress");
+			if (err)
+				goto error;
+			if (cmdargs.stress_cycles < 0) {
+				prerror("--stress CYCLES must not be negative\n");
+				goto error;
+			}
+		} else if (arg_match(argv, &i, "--stress-off", 0, &param)) {
+			err = parse_int(param, &cmdargs.stress_off, "--stress-off");
+			if (err)
+				goto error;
+			if (cmdargs.stress_off < 0) {
+				prerror("--stress-off MSEC must not be negative\n");
+				goto error;
+			}
+		} else if (arg_match(argv, &i, "--stress-on", 0, &param)) {
+			err = parse_int(param, &cmdargs.stress_on, "--stress-on");
+			if (err)
+				goto error;
+			if (cmdargs.stress_on < 0) {
+				prerror("--stress-on MSEC must not be negative\n");
+				goto error;
+			}
+		} else if (arg_match(argv, &i, "--stress-timeout", 0, &param)) {
+			err = parse_int(param, &cmdargs.stress_timeout, "--stress-timeout");
+			if (err)
+				goto error;
+			if (cmdargs.stress_timeout < 0) {
+				prerror("--stress-timeout MSEC must not be negative\n");
+				goto error;
+			}
+		} else if (arg_match(argv, &i, "--wd-limit", 0, &param)) {
+			err = parse_wd_limit(param);
+			if (err)
+				goto error;
+		} else if (arg_match(argv, &i, "--clock", 0, &param)) {
+			err = parse_double(param, &cmdargs.clock_time, "--clock");
+			if (err)
+				goto error;
+			if (cmdargs.clock_time < 0.0) {
+				prerror("--clock SEC must not be negative\n");
+				goto error;
+			}
+			cmdargs.clock = 1;
+		} else if (arg_match(argv, &i, "--clock-tau", 0, &param)) {
+			err = parse_clock_tau(param);
+			if (err)
+				goto error;
+		} else if (arg_match(argv, &i, "--rate", 0, &param)) {
+			err = parse_rate(param);
+			if (err)
+				goto error;
+		} else if (arg_match(argv, &i, "--rate-time", 0, &param)) {
+			err = parse_double(param, &cmdargs.rate_time, "--rate-time");
+			if (err)
+				goto error;
+			if (cmdargs.rate_time < 0.0) {
+				prerror("--rate-time SEC must not be negative\n");
+				goto error;
+			}
+		} else if (arg_match(argv, &i, "--edges", 0, &param)) {
+			err = parse_double(param, &cmdargs.edges_time, "--edges");
+			if (err)
+				goto error;
+			if (cmdargs.edges_time < 0.0) {
+				prerror("--edges SEC must not be negative\n");
+				goto error;
+			}
+			cmdargs.edges = 1;
+		} else if (arg_match(argv, &i, "--inrush", 0, &param)) {
+			cmdargs.inrush_channel = pcibx_measure_find(param);
+			if (cmdargs.inrush_channel < 0 ||
+			    !pcibx_measure_is_current(cmdargs.inrush_channel)) {
+				prerror("Invalid parameter to --inrush\n");
+				goto error;
+			}
+		} else if (arg_match(argv, &i, "--inrush-off", 0, &param)) {
+			err = parse_int(param, &cmdargs.inrush_off, "--inrush-off");
+			if (err)
+				goto error;
+			if (cmdargs.inrush_off < 0) {
+				prerror("--inrush-off MSEC must not be negative\n");
+				goto error;
+			}
+		} else if (arg_match(argv, &i, "--inrush-timeout", 0, &param)) {
+			err = parse_int(param, &cmdargs.inrush_timeout, "--inrush-timeout");
+			if (err)
+				goto error;
+			if (cmdargs.inrush_timeout < 0) {
+				prerror("--inrush-timeout MSEC must not be negative\n");
+				goto error;
+			}
+		} else if (arg_match(argv, &i, "--wd-ratio", 0, &param)) {
+			err = parse_int(param, &cmdargs.wd_ratio, "--wd-ratio");
+			if (err)
+				goto error;
+			if (cmdargs.wd_ratio < 1) {
+				prerror("--wd-ratio must be at least 1\n");
+				goto error;
+			}
+		} else if (arg_match(argv, &i, "--stress-channel", 0, &param)) {
+			if (strcasecmp(param, "none") == 0)
+				cmdargs.stress_channel = -1;
+			else
+				cmdargs.stress_channel = pcibx_measure_find(param);
+			if (strcasecmp(param, "none") != 0 &&
+			    (cmdargs.stress_channel < 0 ||
+			     !pcibx_measure_is_current(cmdargs.stress_channel))) {
+				prerror("Invalid parameter to --stress-channel\n");
+				goto error;
+			}
 		} else if (arg_match(argv, &i, "--cmd-glob", 0, &param)) {
 			err = add_boolcommand(CMD_GLOB, param, "--cmd-glob");
 			if (err)
@@ -618,16 +1739,77 @@ static int parse_args(int argc, char **argv)
 			err = add_command(CMD_GETPME);
 			if (err)
 				goto error;
+		} else if (arg_match(argv, &i, "--cmd-phase", 0, &param)) {
+			err = add_strcommand(CMD_PHASE, param);
+			if (err)
+				goto error;
+		} else if (arg_match(argv, &i, "--cmd-glitch", 0, &param)) {
+			err = add_glitchcommand(param);
+			if (err)
+				goto error;
 		} else {
 			prerror("Unrecognized argument: %s\n", argv[i]);
 			goto error;
 		}
 	}
-	if (cmdargs.nr_commands == 0) {
+	if (cmdargs.nr_ports == 0)
+		cmdargs.ports[cmdargs.nr_ports++] = "/dev/parport0";
+	if (cmdargs.stress_cycles && cmdargs.nr_ports > 1) {
+		prerror("--stress only supports a single port.\n");
+		goto error;
+	}
+	if (cmdargs.nr_wd_limits && cmdargs.nr_ports > 1) {
+		prerror("--wd-limit only supports a single port.\n");
+		goto error;
+	}
+	if (cmdargs.clock && cmdargs.nr_ports > 1) {
+		prerror("--clock only supports a single port.\n");
+		goto error;
+	}
+	if (cmdargs.probe_file && cmdargs.nr_ports > 1) {
+		prerror("--probe-timing only supports a single port.\n");
+		goto error;
+	}
+	if (cmdargs.inrush_channel >= 0 && cmdargs.nr_ports > 1) {
+		prerror("--inrush only supports a single port.\n");
+		goto error;
+	}
+	if (cmdargs.nr_rates && cmdargs.nr_ports > 1) {
+		prerror("--rate only supports a single port.\n");
+		goto error;
+	}
+	if (cmdargs.edges && cmdargs.nr_ports > 1) {
+		prerror("--edges only supports a single port.\n");
+		goto error;
+	}
+	if (!!cmdargs.nr_wd_limits + !!cmdargs.stress_cycles + cmdargs.clock +
+	    !!cmdargs.probe_file + (cmdargs.inrush_channel >= 0) +
+	    cmdargs.edges + !!cmdargs.nr_rates > 1) {
+		prerror("--wd-limit, --stress, --clock, --probe-timing, "
+			"--inrush, --edges and --rate are mutually exclusive.\n");
+		goto error;
+	}
+	if (cmdargs.raw_file &&
+	    (cmdargs.energy || cmdargs.shm_name || cmdargs.metrics_file ||
+	     cmdargs.segment > 0.0)) {
+		prerror("--raw measurements are not converted. They can not "
+			"be used with --energy, --segment, --shm or --metrics.\n");
+		goto error;
+	}
+	if (cmdargs.nr_commands == 0 && !cmdargs.shm_read &&
+	    !cmdargs.convert_file &&
+	    !cmdargs.stress_cycles && !cmdargs.nr_wd_limits &&
+	    !cmdargs.clock && !cmdargs.probe_file &&
+	    cmdargs.inrush_channel < 0 && !cmdargs.edges &&
+	    !cmdargs.nr_rates) {
 		prerror("No device commands specified.\n\n");
 		print_usage(argc, argv);
 		goto error;
 	}
+	if (cmdargs.reorder) {
+		cmdargs.nr_commands = optimize_commands(cmdargs.commands,
+							cmdargs.nr_commands);
+	}
 	return 0;
 
 error:
@@ -636,8 +1818,11 @@ error:
 
 static void signal_handler(int sig)
 {
-	prinfo("Signal %d received. Terminating.\n", sig);
-	exit(1);
+	/* Let the main loop shut down cleanly on the first signal.
+	 * A second signal kills us immediately. */
+	if (terminate)
+		exit(1);
+	terminate = 1;
 }
 
 static int setup_sighandler(void)
@@ -656,11 +1841,366 @@ static int setup_sighandler(void)
 	return err;
 }
 
-int main(int argc, char **argv)
+/* Returns the per port name derived from "name".
+ * With multiple ports, "-INDEX" is inserted before the file extension. */
+static char * port_filename(const char *name, unsigned int index)
 {
-	struct pcibx_device dev;
+	const char *ext, *base;
+	char *ret;
+	size_t len;
+
+	if (!name)
+		return NULL;
+	len = strlen(name) + 16;
+	ret = malloce(len);
+	if (cmdargs.nr_ports <= 1) {
+		strcpy(ret, name);
+		return ret;
+	}
+	base = strrchr(name, '/');
+	ext = strrchr(name, '.');
+	if (!ext || (base && ext < base))
+		ext = name + strlen(name);
+	snprintf(ret, len, "%.*s-%u%s", (int)(ext - name), name, index, ext);
+
+	return ret;
+}
+
+static void print_deadband_stats(const struct worker *w)
+{
+	unsigned long total = 0, suppressed = 0;
+	int i;
+
+	for (i = 0; i < NR_COMMAND_IDS; i++) {
+		total += w->deadband[i].total;
+		suppressed += w->deadband[i].suppressed;
+	}
+	if (!total)
+		return;
+	prinfo("Deadband suppressed %lu of %lu samples of %s:",
+	       suppressed, total, cmdargs.ports[w->index]);
+	for (i = 0; i < NR_COMMAND_IDS; i++) {
+		if (w->deadband[i].total) {
+			prinfo("  %s %lu/%lu", command_names[i],
+			       w->deadband[i].suppressed, w->deadband[i].total);
+		}
+	}
+	prinfo("\n");
+}
+
+static void print_latency(FILE *f, const struct histogram *latency)
+{
+	const struct histogram *h;
+	int i;
+
+	fprintf(f, "%-16s %10s %10s %10s %10s %10s  (usec)\n",
+		"command", "count", "p50", "p99", "p999", "max");
+	for (i = 0; i < NR_COMMAND_IDS; i++) {
+		h = &latency[i];
+		if (!h->count)
+			continue;
+		fprintf(f, "%-16s %10llu %10llu %10llu %10llu %10llu\n",
+			command_names[i], (unsigned long long)h->count,
+			(unsigned long long)histogram_percentile(h, 50.0),
+			(unsigned long long)histogram_percentile(h, 99.0),
+			(unsigned long long)histogram_percentile(h, 99.9),
+			(unsigned long long)h->max);
+	}
+}
+
+static void write_latency_file(struct worker *w)
+{
+	char *name;
+	FILE *f;
+
+	name = port_filename(cmdargs.latency_file, w->index);
+	f = fopen(name, "w");
+	if (!f) {
+		prerror("Could not write latency file %s: %s\n",
+			name, strerror(errno));
+	} else {
+		print_latency(f, w->latency);
+		fclose(f);
+	}
+	free(name);
+}
+
+/* All processes using a port with --shared lock the same file.
+ * It lives in the system lock directory, not in /tmp, and
+ * pcibx_device_set_shared() refuses files others can write to. */
+#define SHARED_LOCK_DIR		"/run/lock"
+
+static char * shared_lock_name(const char *port)
+{
+	const char *base;
+	char *name;
+
+	base = strrchr(port, '/');
+	base = base ? base + 1 : port;
+	name = malloce(strlen(SHARED_LOCK_DIR) + strlen(base) + 32);
+	sprintf(name, SHARED_LOCK_DIR "/pcibx-%s.lock", base);
+
+	return name;
+}
+
+static void print_lock_stats(const struct worker *w)
+{
+	const struct pcibx_device *dev = &w->dev;
+
+	if (!dev->shared || !dev->lock_acquisitions)
+		return;
+	prinfo("Port lock of %s: %lu acquisitions, %lu after use by "
+	       "another process, wait %.3f msec total, %.3f msec avg, "
+	       "%.3f msec max\n",
+	       cmdargs.ports[w->index], dev->lock_acquisitions,
+	       dev->lock_foreign, dev->lock_wait_nsec / 1000000.0,
+	       dev->lock_wait_nsec / 1000000.0 / dev->lock_acquisitions,
+	       dev->lock_wait_max / 1000000.0);
+}
+
+static int worker_init(struct worker *w, unsigned int index)
+{
+	char *name;
+	int i, err;
+
+	memset(w, 0, sizeof(*w));
+	w->index = index;
+	w->shm_name = port_filename(cmdargs.shm_name, index);
+	w->metrics_file = port_filename(cmdargs.metrics_file, index);
+
+	if (w->shm_name || w->metrics_file) {
+		/* The metrics are served from the telemetry state,
+		 * which is process private without --shm. */
+		w->telemetry = telemetry_create(w->shm_name);
+		if (!w->telemetry)
+			return -1;
+	}
+	if (w->metrics_file) {
+		w->metrics = metrics_create(w->metrics_file,
+					    cmdargs.metrics_interval);
+	}
+	if (cmdargs.energy) {
+		w->energy = malloce(sizeof(*w->energy));
+		energy_init(w->energy);
+	}
+	if (cmdargs.segment > 0.0) {
+		w->segment = malloce(sizeof(*w->segment));
+		segment_init(w->segment,
+			     cmdargs.nr_ports > 1 ? cmdargs.ports[index] : NULL,
+			     cmdargs.segment);
+	}
+	if (cmdargs.latency || cmdargs.latency_file) {
+		w->latency = malloce(sizeof(*w->latency) * NR_COMMAND_IDS);
+		for (i = 0; i < NR_COMMAND_IDS; i++)
+			histogram_init(&w->latency[i]);
+	}
+	if (cmdargs.backend == &pcibx_backend_sim) {
+		w->sim = malloce(sizeof(*w->sim));
+		pcibx_sim_init(w->sim);
+	}
+	err = pcibx_device_init_backend(&w->dev, cmdargs.ports[index],
+					cmdargs.is_PCI_1, cmdargs.backend,
+					w->sim);
+	if (err)
+		goto err_free;
+	pcibx_device_set_verbose(&w->dev, cmdargs.verbose);
+	pcibx_device_set_evtrace(&w->dev, evtrace);
+	if (cmdargs.shared) {
+		name = shared_lock_name(cmdargs.ports[index]);
+		err = pcibx_device_set_shared(&w->dev, name);
+		free(name);
+		if (err) {
+			pcibx_device_exit(&w->dev);
+			goto err_free;
+		}
+	}
+	if (cmdargs.timing_file) {
+		err = timing_load(&w->dev, cmdargs.timing_file, 1);
+		if (err) {
+			pcibx_device_exit(&w->dev);
+			goto err_free;
+		}
+	}
+	if (cmdargs.trace_file) {
+		name = port_filename(cmdargs.trace_file, index);
+		w->trace = bustrace_create(name);
+		free(name);
+		if (!w->trace) {
+			err = -1;
+			pcibx_device_exit(&w->dev);
+			goto err_free;
+		}
+		pcibx_device_set_trace(&w->dev, w->trace);
+	}
+	if (cmdargs.raw_file) {
+		name = port_filename(cmdargs.raw_file, index);
+		w->raw = rawlog_create(name);
+		free(name);
+		if (!w->raw) {
+			err = -1;
+			bustrace_close(w->trace);
+			pcibx_device_exit(&w->dev);
+			goto err_free;
+		}
+	}
+
+	return 0;
+
+err_free:
+	free(w->sim);
+	free(w->latency);
+	free(w->energy);
+	free(w->segment);
+	metrics_destroy(w->metrics);
+	telemetry_destroy(w->telemetry, w->shm_name);
+	return err;
+}
+
+static void worker_exit(struct worker *w)
+{
+	if (w->metrics)
+		metrics_write(w->metrics, w->telemetry, &w->dev);
+	if (w->energy) {
+		prinfo("Energy of %s:\n", cmdargs.ports[w->index]);
+		energy_print(w->energy);
+		free(w->energy);
+	}
+	if (w->segment) {
+		segment_finish(w->segment);
+		free(w->segment);
+	}
+	print_deadband_stats(w);
+	print_lock_stats(w);
+	if (w->sim) {
+		prinfo("Simulated port accesses of %s: %lu reads, %lu data "
+		       "writes, %lu control writes, %.1f msec delays\n",
+		       cmdargs.ports[w->index], w->sim->nr_reads,
+		       w->sim->nr_writes, w->sim->nr_ctl_writes,
+		       w->dev.delay_usec / 1000.0);
+	}
+	if (w->latency) {
+		if (cmdargs.latency) {
+			prinfo("Command latencies of %s:\n", cmdargs.ports[w->index]);
+			print_latency(stdout, w->latency);
+		}
+		if (cmdargs.latency_file)
+			write_latency_file(w);
+		free(w->latency);
+	}
+	pcibx_device_exit(&w->dev);
+	bustrace_close(w->trace);
+	rawlog_close(w->raw);
+	metrics_destroy(w->metrics);
+	telemetry_destroy(w->telemetry, w->shm_name);
+	free(w->shm_name);
+	free(w->metrics_file);
+	free(w->sim);
+}
+
+static void * worker_thread(void *_w)
+{
+	struct worker *w = _w;
+
+	while (1) {
+		pthread_barrier_wait(&cycle_start);
+		if (stop_workers)
+			break;
+		ev_begin("cycle", "cycle");
+		w->err = send_commands(w);
+		ev_end("cycle", "cycle");
+		pthread_barrier_wait(&cycle_done);
+	}
+
+	return NULL;
+}
+
+static int rate_command(void *_w, const struct pcibx_command *cmd)
+{
+	struct worker *w = _w;
 	int err;
+
+	err = send_command(w, cmd);
+	flush_samples();
+
+	return err;
+}
+
+/* Read the --rate channels with their own periods. */
+static int run_rates(struct worker *w)
+{
+	struct edf_task tasks[ARRAY_SIZE(channel_names)];
+	unsigned int i, n = 0;
+	enum command_id cmd;
+
+	memset(tasks, 0, sizeof(tasks));
+	for (i = 0; i < ARRAY_SIZE(channel_names); i++) {
+		cmd = channel_names[i].cmd;
+		if (cmdargs.rate[cmd] == 0.0)
+			continue;
+		tasks[n].name = channel_names[i].name;
+		tasks[n].cmd.id = cmd;
+		tasks[n].period = (uint64_t)(cmdargs.rate[cmd] * 1000000.0);
+		n++;
+	}
+
+	return edf_run(tasks, n, cmdargs.rate_time, rate_command, w);
+}
+
+/* Run the command program on all ports.
+ * All workers start each cycle at the same time. */
+static int run_workers(void)
+{
 	int nrcycle;
+	int i, err = 0;
+
+	pthread_barrier_init(&cycle_start, NULL, cmdargs.nr_ports + 1);
+	pthread_barrier_init(&cycle_done, NULL, cmdargs.nr_ports + 1);
+	for (i = 0; i < cmdargs.nr_ports; i++) {
+		err = pthread_create(&workers[i].thread, NULL,
+				     worker_thread, &workers[i]);
+		if (err) {
+			prerror("Could not create worker thread: %s\n",
+				strerror(err));
+			internal_error("worker thread creation");
+		}
+	}
+
+	nrcycle = cmdargs.nrcycle;
+	if (nrcycle == 0)
+		nrcycle = -1;
+	while (!terminate) {
+		pthread_barrier_wait(&cycle_start);
+		pthread_barrier_wait(&cycle_done);
+		flush_samples();
+		for (i = 0; i < cmdargs.nr_ports; i++)
+			err |= workers[i].err;
+		if (err)
+			break;
+		if (nrcycle > 0)
+			nrcycle--;
+		if (nrcycle == 0)
+			break;
+		if (cmdargs.cycle_delay) {
+			ev_begin("delay", "cycle delay");
+			msleep(cmdargs.cycle_delay);
+			ev_end("delay", "cycle delay");
+		}
+	}
+
+	stop_workers = 1;
+	pthread_barrier_wait(&cycle_start);
+	for (i = 0; i < cmdargs.nr_ports; i++)
+		pthread_join(workers[i].thread, NULL);
+	pthread_barrier_destroy(&cycle_start);
+	pthread_barrier_destroy(&cycle_done);
+
+	return err;
+}
+
+int main(int argc, char **argv)
+{
+	int err;
+	int i;
 
 	err = setup_sighandler();
 	if (err)
@@ -671,31 +2211,76 @@ int main(int argc, char **argv)
 	else if (err != 0)
 		goto out;
 
-	err = request_priority();
-	if (err)
+	if (cmdargs.shm_read) {
+		err = dump_telemetry(cmdargs.shm_read);
+		goto out;
+	}
+	if (cmdargs.convert_file) {
+		err = rawlog_convert(cmdargs.convert_file);
+		goto out;
+	}
+	if (cmdargs.estimate) {
+		err = run_estimate();
 		goto out;
+	}
 
-	err = pcibx_device_init(&dev, cmdargs.port, cmdargs.is_PCI_1);
+	err = request_priority();
 	if (err)
 		goto out;
-	gettimeofday(&starttime, NULL);
-	nrcycle = cmdargs.nrcycle;
-	if (nrcycle == 0)
-		nrcycle = -1;
-	while (1) {
-		err = send_commands(&dev);
+
+	if (cmdargs.evtrace_file) {
+		evtrace = evtrace_create(cmdargs.evtrace_size);
+		if (!evtrace) {
+			err = -1;
+			goto out;
+		}
+	}
+	workers = malloce(sizeof(*workers) * cmdargs.nr_ports);
+	for (i = 0; i < cmdargs.nr_ports; i++) {
+		err = worker_init(&workers[i], i);
 		if (err)
-			goto out_exit_dev;
-		if (nrcycle > 0)
-			nrcycle--;
-		if (nrcycle == 0)
-			break;
-		if (cmdargs.cycle_delay)
-			msleep(cmdargs.cycle_delay);
+			goto out_exit_workers;
+	}
+	gettimeofday(&starttime, NULL);
+	if (cmdargs.async_output)
+		start_output_thread();
+	if (cmdargs.stress_cycles) {
+		err = stress_run(&workers[0].dev);
+	} else if (cmdargs.inrush_channel >= 0) {
+		err = inrush_run(&workers[0].dev);
+	} else if (cmdargs.probe_file) {
+		err = probe_run(&workers[0].dev);
+	} else if (cmdargs.clock) {
+		err = clock_run(&workers[0].dev);
+	} else if (cmdargs.edges) {
+		err = edges_run(&workers[0].dev);
+	} else if (cmdargs.nr_rates) {
+		err = send_commands(&workers[0]);
+		flush_samples();
+		if (!err)
+			err = run_rates(&workers[0]);
+	} else if (cmdargs.nr_wd_limits) {
+		err = send_commands(&workers[0]);
+		flush_samples();
+		if (!err)
+			err = watchdog_run(&workers[0].dev);
+	} else
+		err = run_workers();
+	if (output_ring)
+		stop_output_thread();
+	if (terminate)
+		prinfo("Signal received. Terminating.\n");
+
+out_exit_workers:
+	while (--i >= 0)
+		worker_exit(&workers[i]);
+	free(workers);
+	if (evtrace) {
+		if (evtrace_write(evtrace, cmdargs.evtrace_file))
+			err = -1;
+		evtrace_destroy(evtrace);
 	}
-
-out_exit_dev:
-	pcibx_device_exit(&dev);
 out:
-	return err ? 1 : 0;
+	free_commands();
+	return (err || terminate) ? 1 : 0;
 }
@@ -26,6 +26,8 @@
 
 #include "utils.h"
 
+#include <signal.h>
+
 #define VERSION		pcibx_stringify(VERSION_)
 
 enum command_id {
@@ -50,6 +52,9 @@ enum command_id {
 	CMD_RST,
 	CMD_RSTDEFAULT,
 	CMD_GETPME,
+	CMD_PHASE,
+	CMD_GLITCH,
+	NR_COMMAND_IDS,
 };
 
 struct pcibx_command {
@@ -57,22 +62,92 @@ struct pcibx_command {
 	union {
 		int boolean;
 		double d;
+		const char *str;
+		const struct glitch *glitch;
 	} u;
 };
 
+struct pcibx_backend;
+struct glitch;
+
 struct cmdline_args {
 	int verbose;
 	int sched;
 	int cycle_delay;
 	int nrcycle;
 
-	const char *port;
+#define MAX_PORTS	16
+	const char *ports[MAX_PORTS];
+	int nr_ports;
 	int is_PCI_1;
+	const struct pcibx_backend *backend;
+	const char *trace_file;
+	const char *evtrace_file;
+	int evtrace_size;
+	int shared;
+
+	const char *shm_name;
+	const char *shm_read;
+	const char *metrics_file;
+	int metrics_interval;
+
+	/* Deadband per command_id. Negative = disabled. */
+	double deadband[NR_COMMAND_IDS];
+	int heartbeat;
+
+	int energy;
+	double segment;
+	int latency;
+	const char *latency_file;
+	int reorder;
+	int async_output;
+	int estimate;
+
+	int stress_cycles;
+	int stress_off;
+	int stress_on;
+	int stress_timeout;
+	int stress_channel;
+
+#define MAX_WD_LIMITS	8
+	struct wd_limit {
+		int channel;	/* enum measure_id */
+		int above;	/* Trip, if above (1) or below (0) "value" */
+		float value;
+	} wd_limits[MAX_WD_LIMITS];
+	int nr_wd_limits;
+	int wd_ratio;
+
+	int clock;
+	double clock_time;
+#define MAX_CLOCK_TAU	16
+	double clock_tau[MAX_CLOCK_TAU];
+	int nr_clock_tau;
+
+	const char *timing_file;
+	const char *probe_file;
+	int probe_margin;
+
+	int inrush_channel;
+	int inrush_off;
+	int inrush_timeout;
+
+	int edges;
+	double edges_time;
+
+	double rate[NR_COMMAND_IDS];	/* msec, 0 = not scheduled */
+	int nr_rates;
+	double rate_time;
+
+	const char *raw_file;
+	const char *convert_file;
 
 #define MAX_COMMAND	512
 	struct pcibx_command commands[MAX_COMMAND];
 	int nr_commands;
 };
 extern struct cmdline_args cmdargs;
+/* Set by SIGINT/SIGTERM. Long running modes should stop. */
+extern volatile sig_atomic_t terminate;
 
 #endif /* PCIBX_H_ */
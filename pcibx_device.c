@@ -22,7 +22,9 @@
 */
 
 #include "pcibx_device.h"
-#include "pcibx.h"
+#include "bustrace.h"
+#include "evtrace.h"
+#include "simboard.h"
 #include "utils.h"
 
 #include <string.h>
@@ -31,43 +33,106 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <sys/ioctl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <pthread.h>
 
 #ifdef __linux__
 # include <linux/ppdev.h>
 #endif
+#if defined(__linux__) && (defined(__i386__) || defined(__x86_64__))
+# include <sys/io.h>
+# define HAVE_DIRECT_IO
+#endif
 
-/* Parport control register bits */
-#define PPCTL_IRQEN	(1 << 4)
-#define PPCTL_READ	(1 << 5)
-#define PPCTL_DATAMASK	0xF
 
+/*
+ * ppdev backend: Every access is an ioctl on /dev/parportX.
+ */
 
-static uint8_t parport_read_data(struct pcibx_device *dev)
+static int ppdev_open(struct pcibx_device *dev, const char *port)
 {
-	uint8_t res = 0;
+#if defined(__linux__)
+	int err;
+
+	dev->fd = open(port, O_RDWR);
+	if (dev->fd < 0) {
+		prerror("Could not open parallel port %s: %s\n",
+			port, strerror(errno));
+		return -1;
+	}
+//FIXME
+#if 0
+	err = ioctl(dev->fd, PPEXCL);
+	if (err) {
+		prerror("Failed to gain exclusive access to the parallel port %s: %s\n",
+			port, strerror(err < 0 ? -err : err));
+		close(dev->fd);
+		return -1;
+	}
+#endif
+	err = ioctl(dev->fd, PPCLAIM);
+	if (err) {
+		prerror("Failed to claim the parallel port %s: %s\n",
+			port, strerror(err < 0 ? -err : err));
+		close(dev->fd);
+		return -1;
+	}
+#else
+# error "Operating system not supported"
+#endif
 
+	return 0;
+}
+
+static void ppdev_close(struct pcibx_device *dev)
+{
 #if defined(__linux__)
-	if (ioctl(dev->fd, PPRDATA, &res))
-		prerror("Failed to read the parallel port data register\n");
+	ioctl(dev->fd, PPRELEASE);
+	close(dev->fd);
 #else
 # error "Operating system not supported"
 #endif
+}
 
-	return res;
+static int ppdev_claim(struct pcibx_device *dev)
+{
+#if defined(__linux__)
+	return ioctl(dev->fd, PPCLAIM);
+#else
+# error "Operating system not supported"
+#endif
 }
 
-static void parport_write_data(struct pcibx_device *dev, uint8_t value)
+static void ppdev_release(struct pcibx_device *dev)
 {
 #if defined(__linux__)
-	if (ioctl(dev->fd, PPWDATA, &value))
-		prerror("Failed to write the parallel port data register\n");
+	ioctl(dev->fd, PPRELEASE);
 #else
 # error "Operating system not supported"
 #endif
 }
 
-static void parport_write_control(struct pcibx_device *dev,
-				  uint8_t mask, uint8_t value)
+static int ppdev_read_data(struct pcibx_device *dev, uint8_t *value)
+{
+#if defined(__linux__)
+	return ioctl(dev->fd, PPRDATA, value);
+#else
+# error "Operating system not supported"
+#endif
+}
+
+static int ppdev_write_data(struct pcibx_device *dev, uint8_t value)
+{
+#if defined(__linux__)
+	return ioctl(dev->fd, PPWDATA, &value);
+#else
+# error "Operating system not supported"
+#endif
+}
+
+static int ppdev_write_control(struct pcibx_device *dev,
+			       uint8_t mask, uint8_t value)
 {
 #if defined(__linux__)
 	struct ppdev_frob_struct frob = {
@@ -78,102 +143,342 @@ static void parport_write_control(struct pcibx_device *dev,
 
 	if (mask & PPCTL_READ) {
 		direction = !!(value & PPCTL_READ);
-		if (ioctl(dev->fd, PPDATADIR, &direction))
+		if (ioctl(dev->fd, PPDATADIR, &direction)) {
 			prerror("Failed to set parallel port data direction\n");
+			return -1;
+		}
 	}
 	frob.mask &= ~PPCTL_READ;
 	frob.val &= frob.mask;
-	if (ioctl(dev->fd, PPFCONTROL, &frob))
-		prerror("Failed to write the parallel port control register\n");
+	if (frob.mask)
+		return ioctl(dev->fd, PPFCONTROL, &frob);
 #else
 # error "Operating system not supported"
 #endif
+
+	return 0;
 }
 
-static int parport_open(struct pcibx_device *dev, const char *port)
+const struct pcibx_backend pcibx_backend_ppdev = {
+	.name		= "ppdev",
+	.open		= ppdev_open,
+	.close		= ppdev_close,
+	.claim		= ppdev_claim,
+	.release	= ppdev_release,
+	.read_data	= ppdev_read_data,
+	.write_data	= ppdev_write_data,
+	.write_control	= ppdev_write_control,
+};
+
+
+/*
+ * Direct backend: inb/outb on the port base address.
+ * Needs ioperm() privilege (CAP_SYS_RAWIO).
+ * The port is the I/O base address, for example 0x378.
+ */
+
+#define DIRECT_DATA(dev)	((dev)->iobase + 0)
+#define DIRECT_CONTROL(dev)	((dev)->iobase + 2)
+
+static int direct_open(struct pcibx_device *dev, const char *port)
 {
-#if defined(__linux__)
-	int err;
+#ifdef HAVE_DIRECT_IO
+	unsigned long base;
+	char *end;
 
-	dev->fd = open(port, O_RDWR);
-	if (dev->fd < 0) {
-		prerror("Could not open parallel port %s: %s\n",
-			port, strerror(errno));
+	errno = 0;
+	base = strtoul(port, &end, 0);
+	if (errno || *end != '\0' || base == 0 || base > 0xFFFF - 2) {
+		prerror("Invalid I/O base address %s. Format: 0x378\n", port);
 		return -1;
 	}
-//FIXME
-#if 0
-	err = ioctl(dev->fd, PPEXCL);
-	if (err) {
-		prerror("Failed to gain exclusive access to the parallel port %s: %s\n",
-			port, strerror(err < 0 ? -err : err));
-		close(dev->fd);
-		return -1;
-	}
-#endif
-	err = ioctl(dev->fd, PPCLAIM);
-	if (err) {
-		prerror("Failed to claim the parallel port %s: %s\n",
-			port, strerror(err < 0 ? -err : err));
-		close(dev->fd);
+	if (ioperm(base, 3, 1)) {
+		prerror("Could not get I/O permission for port 0x%lX: %s\n",
+			base, strerror(errno));
 		return -1;
 	}
+	dev->iobase = base;
+	dev->ctl = inb(DIRECT_CONTROL(dev));
+
+	return 0;
 #else
-# error "Operating system not supported"
+	prerror("The direct I/O backend is not supported on this platform\n");
+	return -1;
 #endif
+}
 
-	parport_write_control(dev, PPCTL_DATAMASK | PPCTL_READ | PPCTL_IRQEN, 0xE);
+static void direct_close(struct pcibx_device *dev)
+{
+#ifdef HAVE_DIRECT_IO
+	ioperm(dev->iobase, 3, 0);
+#endif
+}
 
+static int direct_read_data(struct pcibx_device *dev, uint8_t *value)
+{
+#ifdef HAVE_DIRECT_IO
+	*value = inb(DIRECT_DATA(dev));
+#endif
 	return 0;
 }
 
-static void parport_close(struct pcibx_device *dev)
+static int direct_write_data(struct pcibx_device *dev, uint8_t value)
 {
-#if defined(__linux__)
-	ioctl(dev->fd, PPRELEASE);
-	close(dev->fd);
-#else
-# error "Operating system not supported"
+#ifdef HAVE_DIRECT_IO
+	outb(value, DIRECT_DATA(dev));
+#endif
+	return 0;
+}
+
+static int direct_write_control(struct pcibx_device *dev,
+				uint8_t mask, uint8_t value)
+{
+#ifdef HAVE_DIRECT_IO
+	/* The data direction is bit 5 of the control register,
+	 * so this is a single outb. dev->ctl already holds the
+	 * new register value. */
+	outb(dev->ctl, DIRECT_CONTROL(dev));
 #endif
+	return 0;
+}
+
+const struct pcibx_backend pcibx_backend_direct = {
+	.name		= "direct",
+	.open		= direct_open,
+	.close		= direct_close,
+	.read_data	= direct_read_data,
+	.write_data	= direct_write_data,
+	.write_control	= direct_write_control,
+};
+
+
+/*
+ * estimate backend: No hardware access at all. The delays are
+ * accounted in dev->delay_usec instead of waited for.
+ * All registers read as 0xFF, so RST# is always de-asserted.
+ */
+
+static int estimate_open(struct pcibx_device *dev, const char *port)
+{
+	return 0;
+}
+
+static void estimate_close(struct pcibx_device *dev)
+{
+}
+
+static int estimate_read_data(struct pcibx_device *dev, uint8_t *value)
+{
+	*value = 0xFF;
+	return 0;
+}
+
+static int estimate_write_data(struct pcibx_device *dev, uint8_t value)
+{
+	return 0;
+}
+
+static int estimate_write_control(struct pcibx_device *dev,
+				  uint8_t mask, uint8_t value)
+{
+	return 0;
+}
+
+const struct pcibx_backend pcibx_backend_estimate = {
+	.name		= "estimate",
+	.open		= estimate_open,
+	.close		= estimate_close,
+	.read_data	= estimate_read_data,
+	.write_data	= estimate_write_data,
+	.write_control	= estimate_write_control,
+	.virtual_time	= 1,
+};
+
+const struct pcibx_backend * pcibx_backend_find(const char *name)
+{
+	if (strcmp(name, pcibx_backend_ppdev.name) == 0)
+		return &pcibx_backend_ppdev;
+	if (strcmp(name, pcibx_backend_direct.name) == 0)
+		return &pcibx_backend_direct;
+	if (strcmp(name, pcibx_backend_replay.name) == 0)
+		return &pcibx_backend_replay;
+	if (strcmp(name, pcibx_backend_sim.name) == 0)
+		return &pcibx_backend_sim;
+	return NULL;
+}
+
+
+static void ev_begin(struct pcibx_device *dev,
+		     const char *cat, const char *name)
+{
+	if (dev->evtrace)
+		evtrace_log(dev->evtrace, 'B', cat, name);
+}
+
+static void ev_end(struct pcibx_device *dev,
+		   const char *cat, const char *name)
+{
+	if (dev->evtrace)
+		evtrace_log(dev->evtrace, 'E', cat, name);
+}
+
+static uint8_t parport_read_data(struct pcibx_device *dev)
+{
+	uint8_t res = 0;
+
+	dev->bus_cycles++;
+	ev_begin(dev, "io", "rdata");
+	if (dev->backend->read_data(dev, &res)) {
+		dev->io_errors++;
+		prerror("Failed to read the parallel port data register\n");
+	}
+	ev_end(dev, "io", "rdata");
+	if (dev->trace)
+		bustrace_log(dev->trace, BUSTRACE_RDATA, 0, res);
+
+	return res;
+}
+
+static void parport_write_data(struct pcibx_device *dev, uint8_t value)
+{
+	dev->bus_cycles++;
+	ev_begin(dev, "io", "wdata");
+	if (dev->backend->write_data(dev, value)) {
+		dev->io_errors++;
+		prerror("Failed to write the parallel port data register\n");
+	}
+	ev_end(dev, "io", "wdata");
+	if (dev->trace)
+		bustrace_log(dev->trace, BUSTRACE_WDATA, 0, value);
+}
+
+static void parport_write_control(struct pcibx_device *dev,
+				  uint8_t mask, uint8_t value)
+{
+	uint8_t ctl;
+
+	/* Only touch the bits that actually change. If the port
+	 * state is unknown, write all bits from the shadow, so that
+	 * the shadow is valid afterwards. */
+	ctl = (dev->ctl & ~mask) | (value & mask);
+	if (dev->ctl_valid)
+		mask &= (ctl ^ dev->ctl);
+	else
+		mask = PPCTL_MASK;
+	dev->ctl = ctl;
+	dev->ctl_valid = 1;
+	if (!mask)
+		return;
+
+	dev->bus_cycles++;
+	ev_begin(dev, "io", "wctl");
+	if (dev->backend->write_control(dev, mask, ctl & mask)) {
+		dev->io_errors++;
+		prerror("Failed to write the parallel port control register\n");
+	}
+	ev_end(dev, "io", "wctl");
+	if (dev->trace)
+		bustrace_log(dev->trace, BUSTRACE_WCTL, mask, ctl & mask);
+}
+
+static int parport_open(struct pcibx_device *dev, const char *port)
+{
+	int err;
+
+	err = dev->backend->open(dev, port);
+	if (err)
+		return err;
+	parport_write_control(dev, PPCTL_MASK, 0xE);
+
+	return 0;
+}
+
+static void parport_close(struct pcibx_device *dev)
+{
+	dev->backend->close(dev);
+}
+
+/* "what" names the delay in the event trace. */
+static void pcibx_udelay(struct pcibx_device *dev, unsigned int usecs,
+			 const char *what)
+{
+	if (dev->backend->virtual_time) {
+		dev->delay_usec += usecs;
+		return;
+	}
+	ev_begin(dev, "delay", what);
+	udelay(usecs);
+	ev_end(dev, "delay", what);
+}
+
+static void pcibx_msleep(struct pcibx_device *dev, unsigned int msecs,
+			 const char *what)
+{
+	if (dev->backend->virtual_time) {
+		dev->delay_usec += (uint64_t)msecs * 1000;
+		return;
+	}
+	ev_begin(dev, "delay", what);
+	msleep(msecs);
+	ev_end(dev, "delay", what);
 }
 
 static void pcibx_set_address(struct pcibx_device *dev,
 			      uint8_t address)
 {
+	ev_begin(dev, "bus", "address");
 	parport_write_control(dev, PPCTL_DATAMASK, 0xE);
 	parport_write_data(dev, address + dev->regoffset);
 	parport_write_control(dev, PPCTL_DATAMASK, 0x6);
-	udelay(100);
+	pcibx_udelay(dev, dev->strobe_usec, "address strobe");
 	parport_write_control(dev, PPCTL_DATAMASK, 0xE);
+	ev_end(dev, "bus", "address");
 }
 
-static void pcibx_write_data(struct pcibx_device *dev,
-			     uint8_t data)
+/* Returns the CLOCK_MONOTONIC time of the data strobe. */
+static uint64_t pcibx_write_data(struct pcibx_device *dev,
+				 uint8_t data)
 {
+	uint64_t t;
+
+	ev_begin(dev, "bus", "write");
 	parport_write_data(dev, data);
 	parport_write_control(dev, PPCTL_DATAMASK, 0xC);
-	udelay(100);
+	t = monotonic_nsec();
+	pcibx_udelay(dev, dev->strobe_usec, "data strobe");
 	parport_write_control(dev, PPCTL_DATAMASK, 0xE);
+	ev_end(dev, "bus", "write");
+
+	return t;
 }
 
 static void pcibx_write_data_ext(struct pcibx_device *dev,
 				 uint8_t data)
 {
+	ev_begin(dev, "bus", "write ext");
 	parport_write_control(dev, PPCTL_DATAMASK, 0xE);
 	parport_write_data(dev, data);
 	parport_write_control(dev, PPCTL_DATAMASK, 0xC);
-	msleep(2);
+	/* Sleep the whole msecs and busy wait the rest, so that
+	 * probed widths are not rounded down. */
+	if (dev->write_ext_usec >= 1000)
+		pcibx_msleep(dev, dev->write_ext_usec / 1000, "write ext");
+	if (dev->write_ext_usec % 1000)
+		pcibx_udelay(dev, dev->write_ext_usec % 1000, "write ext");
 	parport_write_control(dev, PPCTL_DATAMASK, 0xE);
+	ev_end(dev, "bus", "write ext");
 }
 
 static uint8_t pcibx_read_data(struct pcibx_device *dev)
 {
 	uint8_t v;
 
+	ev_begin(dev, "bus", "read");
 	parport_write_control(dev, PPCTL_DATAMASK | PPCTL_READ,
 			      PPCTL_READ | 0xF);
 	v = parport_read_data(dev);
 	parport_write_control(dev, PPCTL_DATAMASK | PPCTL_READ, 0xE);
+	ev_end(dev, "bus", "read");
 
 	return v;
 }
@@ -201,164 +506,628 @@ static uint8_t pcibx_read(struct pcibx_device *dev,
 	return pcibx_read_data(dev);
 }
 
+/* Read the registers regs[0..count-1] into values[].
+ * The address has to be driven on the data lines, so the data
+ * direction still needs to be turned around for every register.
+ * But all redundant control and direction writes between the
+ * reads are skipped (see parport_write_control()). */
+static void pcibx_read_burst(struct pcibx_device *dev,
+			     const uint8_t *regs,
+			     uint8_t *values,
+			     unsigned int count)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++)
+		values[i] = pcibx_read(dev, regs[i]);
+}
+
+static const char *measure_names[PCIBX_NR_MEASURE] = {
+	[MEASURE_INDEX(MEASURE_V25REF)]	= "v25ref",
+	[MEASURE_INDEX(MEASURE_V12UUT)]	= "v12uut",
+	[MEASURE_INDEX(MEASURE_V5UUT)]	= "v5uut",
+	[MEASURE_INDEX(MEASURE_V33UUT)]	= "v33uut",
+	[MEASURE_INDEX(MEASURE_V5AUX)]	= "v5aux",
+	[MEASURE_INDEX(MEASURE_A5)]	= "a5",
+	[MEASURE_INDEX(MEASURE_A12)]	= "a12",
+	[MEASURE_INDEX(MEASURE_A33)]	= "a33",
+};
+
+const struct pcibx_rail pcibx_rails[PCIBX_NR_RAILS] = {
+	{ .name = "5V",   .volt = MEASURE_V5UUT,  .amp = MEASURE_A5, },
+	{ .name = "12V",  .volt = MEASURE_V12UUT, .amp = MEASURE_A12, },
+	{ .name = "3.3V", .volt = MEASURE_V33UUT, .amp = MEASURE_A33, },
+};
+
+const char * pcibx_measure_name(enum measure_id id)
+{
+	return measure_names[MEASURE_INDEX(id)];
+}
+
+/* Returns the measure_id for a channel name, or -1. */
+int pcibx_measure_find(const char *name)
+{
+	int i;
+
+	for (i = 0; i < PCIBX_NR_MEASURE; i++) {
+		if (strcasecmp(name, measure_names[i]) == 0)
+			return i + MEASURE_V25REF;
+	}
+
+	return -1;
+}
+
+int pcibx_measure_is_current(enum measure_id id)
+{
+	return (id == MEASURE_A5 ||
+		id == MEASURE_A12 ||
+		id == MEASURE_A33);
+}
+
 int pcibx_device_init(struct pcibx_device *dev,
 		      const char *port,
-		      int is_pci1)
+		      int is_pci1,
+		      const struct pcibx_backend *backend)
+{
+	return pcibx_device_init_backend(dev, port, is_pci1, backend, NULL);
+}
+
+/* Like pcibx_device_init(), but hand "priv" to the backend in
+ * dev->backend_priv before it is opened. This is how a test
+ * harness injects its own port shim (see pcibx_backend_sim). */
+int pcibx_device_init_backend(struct pcibx_device *dev,
+			      const char *port,
+			      int is_pci1,
+			      const struct pcibx_backend *backend,
+			      void *priv)
 {
+	pthread_mutexattr_t attr;
+	int err;
+
 	memset(dev, 0, sizeof(*dev));
+	dev->port = port;
+	dev->backend = backend ? backend : &pcibx_backend_ppdev;
+	dev->backend_priv = priv;
 	if (is_pci1)
 		dev->regoffset = PCIBX_REGOFFSET_PCI1;
 	else
 		dev->regoffset = PCIBX_REGOFFSET_PCI2;
+	dev->strobe_usec = PCIBX_STROBE_USEC;
+	dev->write_ext_usec = PCIBX_WRITE_EXT_MSEC * 1000;
+
+	/* Recursive, so that commands can be built from other
+	 * commands and callers can group commands with
+	 * pcibx_device_lock(). */
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&dev->lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	err = parport_open(dev, port);
+	if (err)
+		pthread_mutex_destroy(&dev->lock);
+
+	return err;
+}
+
+static void shared_acquire(struct pcibx_device *dev)
+{
+	uint64_t t0, wait, gen = 0;
+	int err;
+
+	t0 = monotonic_nsec();
+	ev_begin(dev, "lock", "port lock");
+	do {
+		err = flock(dev->lock_fd, LOCK_EX);
+	} while (err && errno == EINTR);
+	if (err) {
+		prerror("Could not lock the port: %s\n", strerror(errno));
+		dev->io_errors++;
+	}
+	if (dev->backend->claim && dev->backend->claim(dev)) {
+		prerror("Failed to claim the parallel port %s\n", dev->port);
+		dev->io_errors++;
+	}
+	ev_end(dev, "lock", "port lock");
+	wait = monotonic_nsec() - t0;
+	dev->lock_acquisitions++;
+	dev->lock_wait_nsec += wait;
+	if (wait > dev->lock_wait_max)
+		dev->lock_wait_max = wait;
+
+	if (pread(dev->lock_fd, &gen, sizeof(gen), 0) != sizeof(gen))
+		gen = 0;
+	if (gen != dev->lock_gen) {
+		/* Someone else used the bus. The board and
+		 * the port are in an unknown state. */
+		dev->lock_foreign++;
+		dev->ctl_valid = 0;
+		dev->measure_sel = 0;
+		dev->switch_known = 0;
+	}
+}
+
+/* "release_port" is 0, if the port was closed already. */
+static void shared_release(struct pcibx_device *dev, int release_port)
+{
+	uint64_t gen;
+
+	if (pread(dev->lock_fd, &gen, sizeof(gen), 0) != sizeof(gen))
+		gen = 0;
+	dev->lock_gen = gen + 1;
+	if (pwrite(dev->lock_fd, &dev->lock_gen, sizeof(dev->lock_gen), 0) !=
+	    sizeof(dev->lock_gen))
+		dev->lock_gen = 0;
+	if (release_port && dev->backend->release)
+		dev->backend->release(dev);
+	flock(dev->lock_fd, LOCK_UN);
+}
+
+/* Set the strobe widths. See PCIBX_STROBE_USEC and
+ * PCIBX_WRITE_EXT_MSEC for the defaults. */
+void pcibx_device_set_timing(struct pcibx_device *dev,
+			     unsigned int strobe_usec,
+			     unsigned int write_ext_usec)
+{
+	pthread_mutex_lock(&dev->lock);
+	dev->strobe_usec = strobe_usec;
+	dev->write_ext_usec = write_ext_usec;
+	pthread_mutex_unlock(&dev->lock);
+}
+
+/* Print every command sent to the device, if verbose >= 2. */
+void pcibx_device_set_verbose(struct pcibx_device *dev, int verbose)
+{
+	dev->verbose = verbose;
+}
+
+static void switch_set(struct pcibx_device *dev, enum pcibx_switch rail,
+		       int on)
+{
+	uint8_t bit = 1 << (rail - PCIBX_REG_UUTVOLT);
+
+	dev->switch_known |= bit;
+	if (on)
+		dev->switch_on |= bit;
+	else
+		dev->switch_on &= ~bit;
+}
+
+/* Returns 1, if the rail is on, 0 if it is off or -1 if unknown.
+ * The state is known after a switch command of this device. The
+ * UUT state is read from RST# otherwise. */
+int pcibx_device_switch_state(struct pcibx_device *dev,
+			      enum pcibx_switch rail)
+{
+	uint8_t bit = 1 << (rail - PCIBX_REG_UUTVOLT);
+	int state = -1;
+
+	pcibx_device_lock(dev);
+	if (dev->switch_known & bit)
+		state = !!(dev->switch_on & bit);
+	else if (rail == PCIBX_SWITCH_UUT)
+		state = !!(pcibx_read(dev, PCIBX_REG_STATUS) & PCIBX_STATUS_RSTDEASS);
+	pcibx_device_unlock(dev);
+
+	return state;
+}
+
+/* Forget the channel the measurement multiplexer selects. The next
+ * measurement selects it again and waits for the input to settle.
+ * The power, AUX and glitch commands do this, as switching a supply
+ * steps the analog inputs. */
+void pcibx_device_invalidate_measure(struct pcibx_device *dev)
+{
+	pcibx_device_lock(dev);
+	dev->measure_sel = 0;
+	pcibx_device_unlock(dev);
+}
 
-	return parport_open(dev, port);
+/* All pcibx_cmd_* functions are serialized per device.
+ * Take the lock explicitly to run a sequence of commands
+ * without other threads interleaving. */
+void pcibx_device_lock(struct pcibx_device *dev)
+{
+	pthread_mutex_lock(&dev->lock);
+	if (dev->shared && dev->lock_depth++ == 0)
+		shared_acquire(dev);
+}
+
+void pcibx_device_unlock(struct pcibx_device *dev)
+{
+	if (dev->shared && --dev->lock_depth == 0)
+		shared_release(dev, 1);
+	pthread_mutex_unlock(&dev->lock);
+}
+
+static int in_group(gid_t gid)
+{
+	gid_t groups[256];
+	int i, n;
+
+	if (gid == getegid())
+		return 1;
+	n = getgroups(ARRAY_SIZE(groups), groups);
+	for (i = 0; i < n; i++) {
+		if (groups[i] == gid)
+			return 1;
+	}
+	return 0;
+}
+
+/* Only trust a lock file that no stranger can write to. Otherwise
+ * anybody could hold the lock forever or corrupt the counter. */
+static int lockfile_trusted(int fd)
+{
+	struct stat st;
+
+	if (fstat(fd, &st))
+		return 0;
+	if (!S_ISREG(st.st_mode) || (st.st_mode & S_IWOTH))
+		return 0;
+	if (st.st_uid == geteuid() || st.st_uid == 0)
+		return 1;
+	return (st.st_mode & S_IWGRP) && in_group(st.st_gid);
+}
+
+/* Share the port with other processes. The port is only claimed
+ * while a command (or a pcibx_device_lock() section) runs.
+ * "lockfile" arbitrates between the processes and holds a
+ * counter of the bus sequences, so that a process notices when
+ * another one used the bus in between. */
+int pcibx_device_set_shared(struct pcibx_device *dev, const char *lockfile)
+{
+	dev->lock_fd = open(lockfile, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC,
+			    0660);
+	if (dev->lock_fd < 0) {
+		prerror("Could not open the port lock %s: %s\n",
+			lockfile, strerror(errno));
+		return -1;
+	}
+	if (!lockfile_trusted(dev->lock_fd)) {
+		prerror("The port lock %s is not a regular file or is "
+			"writable by other users\n", lockfile);
+		close(dev->lock_fd);
+		return -1;
+	}
+	/* Let the group share the port, regardless of the umask. */
+	fchmod(dev->lock_fd, 0660);
+	pthread_mutex_lock(&dev->lock);
+	/* The state set up by the open is current as of the present
+	 * generation. Only later uses by others are foreign. */
+	flock(dev->lock_fd, LOCK_EX);
+	if (pread(dev->lock_fd, &dev->lock_gen, sizeof(dev->lock_gen), 0) !=
+	    sizeof(dev->lock_gen))
+		dev->lock_gen = 0;
+	/* The port was claimed by the open. */
+	if (dev->backend->release)
+		dev->backend->release(dev);
+	flock(dev->lock_fd, LOCK_UN);
+	dev->shared = 1;
+	pthread_mutex_unlock(&dev->lock);
+
+	return 0;
+}
+
+/* Record the timeline of all following bus transactions and
+ * delays to "evtrace". */
+void pcibx_device_set_evtrace(struct pcibx_device *dev,
+			      struct evtrace *evtrace)
+{
+	pthread_mutex_lock(&dev->lock);
+	dev->evtrace = evtrace;
+	pthread_mutex_unlock(&dev->lock);
+}
+
+/* Record all following bus transactions to "trace".
+ * The trace starts with the port initialization done by
+ * pcibx_device_init(), so that it can be replayed. */
+void pcibx_device_set_trace(struct pcibx_device *dev,
+			    struct bustrace *trace)
+{
+	const uint8_t mask = PPCTL_MASK;
+
+	pthread_mutex_lock(&dev->lock);
+	dev->trace = trace;
+	if (trace)
+		bustrace_log(trace, BUSTRACE_WCTL, mask, dev->ctl & mask);
+	pthread_mutex_unlock(&dev->lock);
 }
 
 void pcibx_device_exit(struct pcibx_device *dev)
 {
+	/* The backend expects a claimed port on close. */
+	pcibx_device_lock(dev);
 	parport_close(dev);
+	if (dev->shared) {
+		/* Publish the use of the bus, but the port is
+		 * released by the close already. */
+		dev->lock_depth = 0;
+		shared_release(dev, 0);
+		close(dev->lock_fd);
+	}
+	pthread_mutex_unlock(&dev->lock);
+	pthread_mutex_destroy(&dev->lock);
 	memset(dev, 0, sizeof(*dev));
 }
 
-static void prsendinfo(const char *command)
+static void prsendinfo(struct pcibx_device *dev, const char *command)
 {
-	if (cmdargs.verbose >= 2)
+	if (dev->verbose >= 2)
 		prinfo("Sending command: %s\n", command);
 }
 
 void pcibx_cmd_global_pwr(struct pcibx_device *dev, int on)
 {
+	pcibx_device_lock(dev);
 	if (on) {
-		prsendinfo("Global Power ON");
+		prsendinfo(dev, "Global Power ON");
 		pcibx_write(dev, PCIBX_REG_GLOBALPWR, 1);
 	} else {
-		prsendinfo("Global Power OFF");
+		prsendinfo(dev, "Global Power OFF");
 		pcibx_write(dev, PCIBX_REG_GLOBALPWR, 0);
+		dev->switch_known = 0;
 	}
+	pcibx_device_invalidate_measure(dev);
+	pcibx_device_unlock(dev);
 }
 
-void pcibx_cmd_uut_pwr(struct pcibx_device *dev, int on)
+/* Turn the UUT Voltages ON/OFF without waiting for RST#. */
+void pcibx_cmd_uut_pwr_nowait(struct pcibx_device *dev, int on)
 {
+	pcibx_device_lock(dev);
 	if (on) {
 		pcibx_cmd_global_pwr(dev, 1);
-		prsendinfo("UUT Voltages ON");
+		prsendinfo(dev, "UUT Voltages ON");
 		pcibx_write(dev, PCIBX_REG_UUTVOLT, 0);
+	} else {
+		prsendinfo(dev, "UUT Voltages OFF");
+		pcibx_write(dev, PCIBX_REG_UUTVOLT, 1);
+	}
+	switch_set(dev, PCIBX_SWITCH_UUT, on);
+	pcibx_device_invalidate_measure(dev);
+	pcibx_device_unlock(dev);
+}
+
+void pcibx_cmd_uut_pwr(struct pcibx_device *dev, int on)
+{
+	pcibx_device_lock(dev);
+	pcibx_cmd_uut_pwr_nowait(dev, on);
+	if (on) {
 		/* Wait for the RST# to become de-asserted. */
 		do {
-			msleep(200);
+			pcibx_msleep(dev, PCIBX_RST_POLL_MSEC, "rst poll");
 		} while (!(pcibx_read(dev, PCIBX_REG_STATUS) & PCIBX_STATUS_RSTDEASS));
-	} else {
-		prsendinfo("UUT Voltages OFF");
-		pcibx_write(dev, PCIBX_REG_UUTVOLT, 1);
 	}
+	pcibx_device_unlock(dev);
 }
 
 uint8_t pcibx_cmd_getboardid(struct pcibx_device *dev)
 {
-	prsendinfo("Get board ID");
-	return pcibx_read(dev, PCIBX_REG_BOARDID);
+	uint8_t v;
+
+	pcibx_device_lock(dev);
+	prsendinfo(dev, "Get board ID");
+	v = pcibx_read(dev, PCIBX_REG_BOARDID);
+	pcibx_device_unlock(dev);
+
+	return v;
 }
 
 uint8_t pcibx_cmd_getfirmrev(struct pcibx_device *dev)
 {
-	prsendinfo("Get firmware rev");
-	return pcibx_read(dev, PCIBX_REG_FIRMREV);
+	uint8_t v;
+
+	pcibx_device_lock(dev);
+	prsendinfo(dev, "Get firmware rev");
+	v = pcibx_read(dev, PCIBX_REG_FIRMREV);
+	pcibx_device_unlock(dev);
+
+	return v;
 }
 
 uint8_t pcibx_cmd_getstatus(struct pcibx_device *dev)
 {
-	prsendinfo("Get status bits");
-	return pcibx_read(dev, PCIBX_REG_STATUS);
+	uint8_t v;
+
+	pcibx_device_lock(dev);
+	prsendinfo(dev, "Get status bits");
+	v = pcibx_read(dev, PCIBX_REG_STATUS);
+	pcibx_device_unlock(dev);
+
+	return v;
 }
 
 void pcibx_cmd_clearbitstat(struct pcibx_device *dev)
 {
-	prsendinfo("Clear 32/64 bit status");
+	pcibx_device_lock(dev);
+	prsendinfo(dev, "Clear 32/64 bit status");
 	pcibx_write(dev, PCIBX_REG_CLEARBITSTAT, 0);
+	pcibx_device_unlock(dev);
 }
 
 void pcibx_cmd_aux5(struct pcibx_device *dev, int on)
 {
+	pcibx_device_lock(dev);
 	if (on) {
-		prsendinfo("Aux 5V ON");
+		prsendinfo(dev, "Aux 5V ON");
 		pcibx_write(dev, PCIBX_REG_AUX5V, 0);
 	} else {
-		prsendinfo("Aux 5V OFF");
+		prsendinfo(dev, "Aux 5V OFF");
 		pcibx_write(dev, PCIBX_REG_AUX5V, 1);
 	}
+	switch_set(dev, PCIBX_SWITCH_AUX5, on);
+	pcibx_device_invalidate_measure(dev);
+	pcibx_device_unlock(dev);
 }
 
 void pcibx_cmd_aux33(struct pcibx_device *dev, int on)
 {
+	pcibx_device_lock(dev);
 	if (on) {
-		prsendinfo("Aux 3.3V ON");
+		prsendinfo(dev, "Aux 3.3V ON");
 		pcibx_write(dev, PCIBX_REG_AUX33V, 0);
 	} else {
-		prsendinfo("Aux 3.3V OFF");
+		prsendinfo(dev, "Aux 3.3V OFF");
 		pcibx_write(dev, PCIBX_REG_AUX33V, 1);
 	}
+	switch_set(dev, PCIBX_SWITCH_AUX33, on);
+	pcibx_device_invalidate_measure(dev);
+	pcibx_device_unlock(dev);
 }
 
 float pcibx_cmd_sysfreq(struct pcibx_device *dev)
 {
+	static const uint8_t regs[] = {
+		PCIBX_REG_FREQMEASURE_0,
+		PCIBX_REG_FREQMEASURE_1,
+		PCIBX_REG_FREQMEASURE_2,
+	};
+	uint8_t v[3];
 	float mhz;
 	uint32_t tmp;
-	uint32_t v;
 
-	prsendinfo("Measure system frequency");
+	pcibx_device_lock(dev);
+	prsendinfo(dev, "Measure system frequency");
 	pcibx_write(dev, PCIBX_REG_FREQMEASURE_CTL, 1);
-	msleep(15);
-	v = pcibx_read(dev, PCIBX_REG_FREQMEASURE_0);
-	tmp = v;
-	v = pcibx_read(dev, PCIBX_REG_FREQMEASURE_1);
-	tmp |= (v << 8);
-	v = pcibx_read(dev, PCIBX_REG_FREQMEASURE_2);
-	tmp |= (v << 16);
+	pcibx_msleep(dev, PCIBX_FREQ_GATE_MSEC, "freq gate");
+	pcibx_read_burst(dev, regs, v, 3);
+	pcibx_device_unlock(dev);
+	tmp = v[0];
+	tmp |= ((uint32_t)v[1] << 8);
+	tmp |= ((uint32_t)v[2] << 16);
 
 	mhz = (float)tmp * 100.0 / 1048575.0;
 
 	return mhz;
 }
 
-float pcibx_cmd_measure(struct pcibx_device *dev, enum measure_id id)
+static uint16_t measure_raw(struct pcibx_device *dev, enum measure_id id,
+			    int settle)
 {
-	float ret;
+	static const uint8_t regs[] = {
+		PCIBX_REG_MEASURE_DATA0,
+		PCIBX_REG_MEASURE_DATA1,
+	};
+	uint8_t d[2];
 	int i;
-	uint16_t d0, d1;
-	uint16_t tmp;
 
-	prsendinfo("Measuring V/A");
-	pcibx_write(dev, PCIBX_REG_MEASURE_CTL, id);
-	msleep(10);
+	pcibx_device_lock(dev);
+	prsendinfo(dev, "Measuring V/A");
+	/* The input needs 10 msec to settle after switching the
+	 * multiplexer. Skip that, if it already selects the channel. */
+	if (dev->measure_sel != id) {
+		pcibx_write(dev, PCIBX_REG_MEASURE_CTL, id);
+		if (settle)
+			pcibx_msleep(dev, PCIBX_MEASURE_SETTLE_MSEC, "settle");
+		dev->measure_sel = id;
+	}
 	pcibx_write_ext(dev, PCIBX_REG_MEASURE_CONV, 0);
-	msleep(2);
+	pcibx_msleep(dev, PCIBX_MEASURE_CONV_MSEC, "conversion");
 	pcibx_set_address(dev, PCIBX_REG_MEASURE_STROBE);
 	for (i = 0; i < 13; i++)
 		pcibx_write_data(dev, 0);
-	d0 = pcibx_read(dev, PCIBX_REG_MEASURE_DATA0);
-	d1 = pcibx_read(dev, PCIBX_REG_MEASURE_DATA1);
-	tmp = d0;
-	tmp |= (d1 << 8);
+	pcibx_read_burst(dev, regs, d, 2);
+	pcibx_device_unlock(dev);
 
+	return d[0] | (d[1] << 8);
+}
+
+/* Returns the raw 12-bit ADC code. */
+uint16_t pcibx_cmd_measure_raw(struct pcibx_device *dev, enum measure_id id)
+{
+	return measure_raw(dev, id, 1);
+}
+
+/* Volt or Ampere per ADC code */
+float pcibx_measure_scale(enum measure_id id)
+{
 	if (id == MEASURE_V12UUT)
-		ret = (float)tmp * 5.75 * 2.5 / 4096.0;
-	else
-		ret = (float)tmp * 2.26 * 2.5 / 4096.0;
+		return 5.75 * 2.5 / 4096.0;
+	return 2.26 * 2.5 / 4096.0;
+}
 
-	return ret;
+/* Convert "count" raw codes of channel "id" to Volt or Ampere.
+ * This is a plain multiply loop over __restrict pointers,
+ * so the compiler can vectorize it. */
+void pcibx_measure_convert(enum measure_id id,
+			   const uint16_t * __restrict codes,
+			   float * __restrict values,
+			   size_t count)
+{
+	const float scale = pcibx_measure_scale(id);
+	size_t i;
+
+	for (i = 0; i < count; i++)
+		values[i] = (float)codes[i] * scale;
+}
+
+float pcibx_cmd_measure(struct pcibx_device *dev, enum measure_id id)
+{
+	return (float)pcibx_cmd_measure_raw(dev, id) * pcibx_measure_scale(id);
+}
+
+/* Measure without waiting for the input to settle, to sample
+ * a supply step itself. */
+float pcibx_cmd_measure_nosettle(struct pcibx_device *dev, enum measure_id id)
+{
+	return (float)measure_raw(dev, id, 0) * pcibx_measure_scale(id);
+}
+
+/* Wait until the CLOCK_MONOTONIC time "deadline".
+ * Sleep for the most part and spin for the last msec. */
+void pcibx_device_wait_until(struct pcibx_device *dev, uint64_t deadline)
+{
+	uint64_t now = monotonic_nsec();
+
+	if (now >= deadline)
+		return;
+	if (dev->backend->virtual_time) {
+		dev->delay_usec += (deadline - now) / 1000;
+		return;
+	}
+	ev_begin(dev, "delay", "wait");
+	if (deadline - now > 2000000)
+		msleep((deadline - now) / 1000000 - 1);
+	while (monotonic_nsec() < deadline)
+		;
+	ev_end(dev, "delay", "wait");
+}
+
+/* Switch "rail" off for "usec" and on again.
+ * The address is set once, so both edges are a single data
+ * strobe with the same latency. The CLOCK_MONOTONIC times of the
+ * off and on strobes are stored in *t_off and *t_on. */
+void pcibx_cmd_glitch(struct pcibx_device *dev, enum pcibx_switch rail,
+		      unsigned int usec, uint64_t *t_off, uint64_t *t_on)
+{
+	pcibx_device_lock(dev);
+	prsendinfo(dev, "Glitch");
+	pcibx_set_address(dev, rail);
+	*t_off = pcibx_write_data(dev, 1);
+	pcibx_device_wait_until(dev, *t_off + (uint64_t)usec * 1000);
+	*t_on = pcibx_write_data(dev, 0);
+	if (dev->backend->virtual_time)
+		*t_on = *t_off + (uint64_t)usec * 1000;
+	switch_set(dev, rail, 1);
+	pcibx_device_invalidate_measure(dev);
+	pcibx_device_unlock(dev);
 }
 
 void pcibx_cmd_ramp(struct pcibx_device *dev, int fast)
 {
-	prsendinfo("+5V RAMP");
+	pcibx_device_lock(dev);
+	prsendinfo(dev, "+5V RAMP");
 	pcibx_write(dev, PCIBX_REG_RAMP, fast ? 1 : 0);
+	pcibx_device_unlock(dev);
 }
 
 void pcibx_cmd_rst(struct pcibx_device *dev, double sec)
 {
 	uint32_t tmp;
 
-	prsendinfo("RST#");
+	pcibx_device_lock(dev);
+	prsendinfo(dev, "RST#");
 	sec /= 2.56;
 	sec *= 1000000.0;
 	tmp = sec;
@@ -367,18 +1136,27 @@ void pcibx_cmd_rst(struct pcibx_device *dev, double sec)
 	pcibx_write(dev, PCIBX_REG_RST_0, (tmp & 0x000000FF));
 	pcibx_write(dev, PCIBX_REG_RST_1, (tmp & 0x0000FF00) >> 8);
 	pcibx_write(dev, PCIBX_REG_RST_2, (tmp & 0x00FF0000) >> 16);
+	pcibx_device_unlock(dev);
 }
 
 void pcibx_cmd_rstdefault(struct pcibx_device *dev)
 {
-	prsendinfo("default RST#");
+	pcibx_device_lock(dev);
+	prsendinfo(dev, "default RST#");
 	pcibx_write(dev, PCIBX_REG_RST_0, 0);
 	pcibx_write(dev, PCIBX_REG_RST_1, 0);
 	pcibx_write(dev, PCIBX_REG_RST_2, 0);
+	pcibx_device_unlock(dev);
 }
 
 uint8_t pcibx_cmd_getpme(struct pcibx_device *dev)
 {
-	prsendinfo("PME# status");
-	return pcibx_read(dev, PCIBX_REG_PME);
+	uint8_t v;
+
+	pcibx_device_lock(dev);
+	prsendinfo(dev, "PME# status");
+	v = pcibx_read(dev, PCIBX_REG_PME);
+	pcibx_device_unlock(dev);
+
+	return v;
 }
@@ -25,6 +25,16 @@
 #define PCIBX_DEVICE_H_
 
 #include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The API of libpcibx. All other symbols of the library,
+ * like the utils.h helpers, are hidden. */
+#define PCIBX_API	__attribute__((visibility("default")))
 
 #define PCIBX_REG_FIRMREV		0x50
 #define PCIBX_REG_BOARDID		0x53
@@ -58,10 +68,107 @@
 #define PCIBX_STATUS_MHZ	(1 << 3)
 #define PCIBX_STATUS_DUTASS	(1 << 4)
 
+/* Protocol timing */
+#define PCIBX_STROBE_USEC		100	/* Default address and data strobe width */
+#define PCIBX_WRITE_EXT_MSEC		2	/* Default strobe width of slow registers */
+#define PCIBX_MEASURE_SETTLE_MSEC	10	/* ADC input settle time after a channel switch */
+#define PCIBX_MEASURE_CONV_MSEC		2	/* ADC conversion time */
+#define PCIBX_FREQ_GATE_MSEC		15	/* Frequency counter gate time */
+#define PCIBX_RST_POLL_MSEC		200	/* RST# poll interval after UUT power on */
+
+/* Parport control register bits */
+#define PPCTL_IRQEN	(1 << 4)
+#define PPCTL_READ	(1 << 5)
+#define PPCTL_DATAMASK	0xF
+/* All control bits driven by pcibx */
+#define PPCTL_MASK	(PPCTL_DATAMASK | PPCTL_READ | PPCTL_IRQEN)
+
+struct pcibx_device;
+struct bustrace;
+struct evtrace;
+
+/* Low level parallel port access method.
+ * All operations return 0 on success. */
+struct pcibx_backend {
+	const char *name;
+	int (*open)(struct pcibx_device *dev, const char *port);
+	void (*close)(struct pcibx_device *dev);
+	int (*read_data)(struct pcibx_device *dev, uint8_t *value);
+	int (*write_data)(struct pcibx_device *dev, uint8_t value);
+	/* Change the control register bits in "mask" to "value".
+	 * PPCTL_READ is the data direction. */
+	int (*write_control)(struct pcibx_device *dev,
+			     uint8_t mask, uint8_t value);
+	/* Optional. Claim/release the port for a shared access. */
+	int (*claim)(struct pcibx_device *dev);
+	void (*release)(struct pcibx_device *dev);
+	/* Do not wait for the protocol delays, but add them
+	 * to dev->delay_usec. */
+	int virtual_time;
+};
+
+PCIBX_API extern const struct pcibx_backend pcibx_backend_ppdev;
+PCIBX_API extern const struct pcibx_backend pcibx_backend_direct;
+PCIBX_API extern const struct pcibx_backend pcibx_backend_estimate;
+
 struct pcibx_device {
 	const char *port;
-	int fd;
+	const struct pcibx_backend *backend;
+	int fd;			/* ppdev backend */
+	unsigned long iobase;	/* direct backend */
+	void *backend_priv;	/* see pcibx_device_init_backend() */
 	uint8_t regoffset;
+
+	/* Strobe widths */
+	unsigned int strobe_usec;
+	unsigned int write_ext_usec;
+
+	/* Shadow of the parport control register (including the
+	 * data direction bit). Only valid after the first write. */
+	uint8_t ctl;
+	int ctl_valid;
+
+	/* The channel the measurement multiplexer is switched to.
+	 * 0 if unknown. */
+	uint8_t measure_sel;
+
+	/* Last switched state of the UUT and AUX rails, one bit per
+	 * enum pcibx_switch. Only bits in switch_known are valid. */
+	uint8_t switch_known;
+	uint8_t switch_on;
+
+	/* Bus transaction recorder, or NULL. */
+	struct bustrace *trace;
+	/* Timeline event recorder, or NULL. */
+	struct evtrace *evtrace;
+
+	/* Number of failed parport accesses. */
+	unsigned long io_errors;
+	/* Number of parport register accesses. */
+	unsigned long bus_cycles;
+	/* Sum of the protocol delays, with a virtual_time backend. */
+	uint64_t delay_usec;
+
+	int verbose;
+	/* Serializes the pcibx_cmd_* functions. */
+	pthread_mutex_t lock;
+
+	/* Port sharing with other processes */
+	int shared;
+	int lock_fd;
+	int lock_depth;
+	uint64_t lock_gen;
+	unsigned long lock_acquisitions;
+	unsigned long lock_foreign;	/* Bus used by others in between */
+	uint64_t lock_wait_nsec;
+	uint64_t lock_wait_max;
+};
+
+/* Switchable supply rails. Writing 1 turns the rail off, 0 on. */
+enum pcibx_switch {
+	PCIBX_SWITCH_UUT	= PCIBX_REG_UUTVOLT,
+	PCIBX_SWITCH_AUX5	= PCIBX_REG_AUX5V,
+	PCIBX_SWITCH_AUX33	= PCIBX_REG_AUX33V,
 };
 
 enum measure_id {
@@ -74,25 +181,77 @@ enum measure_id {
 	MEASURE_A12	= 0x0E,
 	MEASURE_A33	= 0x0F,
 };
+#define PCIBX_NR_MEASURE	8
+#define MEASURE_INDEX(id)	((id) - MEASURE_V25REF)
 
-int pcibx_device_init(struct pcibx_device *dev,
+/* A UUT supply rail and its voltage and current channels. */
+struct pcibx_rail {
+	const char *name;
+	enum measure_id volt;
+	enum measure_id amp;
+};
+#define PCIBX_NR_RAILS		3
+PCIBX_API extern const struct pcibx_rail pcibx_rails[PCIBX_NR_RAILS];
+
+PCIBX_API const char * pcibx_measure_name(enum measure_id id);
+PCIBX_API int pcibx_measure_find(const char *name);
+PCIBX_API int pcibx_measure_is_current(enum measure_id id);
+PCIBX_API float pcibx_measure_scale(enum measure_id id);
+PCIBX_API void pcibx_measure_convert(enum measure_id id,
+			   const uint16_t * __restrict codes,
+			   float * __restrict values,
+			   size_t count);
+
+PCIBX_API const struct pcibx_backend * pcibx_backend_find(const char *name);
+
+PCIBX_API int pcibx_device_init(struct pcibx_device *dev,
 		      const char *port,
-		      int is_pci1);
-void pcibx_device_exit(struct pcibx_device *dev);
-
-void pcibx_cmd_global_pwr(struct pcibx_device *dev, int on);
-void pcibx_cmd_uut_pwr(struct pcibx_device *dev, int on);
-uint8_t pcibx_cmd_getboardid(struct pcibx_device *dev);
-uint8_t pcibx_cmd_getfirmrev(struct pcibx_device *dev);
-uint8_t pcibx_cmd_getstatus(struct pcibx_device *dev);
-void pcibx_cmd_clearbitstat(struct pcibx_device *dev);
-void pcibx_cmd_aux5(struct pcibx_device *dev, int on);
-void pcibx_cmd_aux33(struct pcibx_device *dev, int on);
-float pcibx_cmd_sysfreq(struct pcibx_device *dev);
-float pcibx_cmd_measure(struct pcibx_device *dev, enum measure_id id);
-void pcibx_cmd_ramp(struct pcibx_device *dev, int fast);
-void pcibx_cmd_rst(struct pcibx_device *dev, double sec);
-void pcibx_cmd_rstdefault(struct pcibx_device *dev);
-uint8_t pcibx_cmd_getpme(struct pcibx_device *dev);
+		      int is_pci1,
+		      const struct pcibx_backend *backend);
+PCIBX_API int pcibx_device_init_backend(struct pcibx_device *dev,
+			      const char *port,
+			      int is_pci1,
+			      const struct pcibx_backend *backend,
+			      void *priv);
+PCIBX_API void pcibx_device_exit(struct pcibx_device *dev);
+PCIBX_API void pcibx_device_set_trace(struct pcibx_device *dev,
+			    struct bustrace *trace);
+PCIBX_API void pcibx_device_set_timing(struct pcibx_device *dev,
+			     unsigned int strobe_usec,
+			     unsigned int write_ext_usec);
+PCIBX_API void pcibx_device_set_evtrace(struct pcibx_device *dev,
+			      struct evtrace *evtrace);
+PCIBX_API void pcibx_device_set_verbose(struct pcibx_device *dev, int verbose);
+PCIBX_API void pcibx_device_invalidate_measure(struct pcibx_device *dev);
+PCIBX_API int pcibx_device_switch_state(struct pcibx_device *dev,
+					enum pcibx_switch rail);
+PCIBX_API int pcibx_device_set_shared(struct pcibx_device *dev, const char *lockfile);
+PCIBX_API void pcibx_device_wait_until(struct pcibx_device *dev, uint64_t deadline);
+PCIBX_API void pcibx_device_lock(struct pcibx_device *dev);
+PCIBX_API void pcibx_device_unlock(struct pcibx_device *dev);
+
+PCIBX_API void pcibx_cmd_global_pwr(struct pcibx_device *dev, int on);
+PCIBX_API void pcibx_cmd_uut_pwr(struct pcibx_device *dev, int on);
+PCIBX_API void pcibx_cmd_uut_pwr_nowait(struct pcibx_device *dev, int on);
+PCIBX_API uint8_t pcibx_cmd_getboardid(struct pcibx_device *dev);
+PCIBX_API uint8_t pcibx_cmd_getfirmrev(struct pcibx_device *dev);
+PCIBX_API uint8_t pcibx_cmd_getstatus(struct pcibx_device *dev);
+PCIBX_API void pcibx_cmd_clearbitstat(struct pcibx_device *dev);
+PCIBX_API void pcibx_cmd_aux5(struct pcibx_device *dev, int on);
+PCIBX_API void pcibx_cmd_aux33(struct pcibx_device *dev, int on);
+PCIBX_API float pcibx_cmd_sysfreq(struct pcibx_device *dev);
+PCIBX_API float pcibx_cmd_measure(struct pcibx_device *dev, enum measure_id id);
+PCIBX_API uint16_t pcibx_cmd_measure_raw(struct pcibx_device *dev, enum measure_id id);
+PCIBX_API float pcibx_cmd_measure_nosettle(struct pcibx_device *dev, enum measure_id id);
+PCIBX_API void pcibx_cmd_ramp(struct pcibx_device *dev, int fast);
+PCIBX_API void pcibx_cmd_rst(struct pcibx_device *dev, double sec);
+PCIBX_API void pcibx_cmd_rstdefault(struct pcibx_device *dev);
+PCIBX_API uint8_t pcibx_cmd_getpme(struct pcibx_device *dev);
+PCIBX_API void pcibx_cmd_glitch(struct pcibx_device *dev, enum pcibx_switch rail,
+		      unsigned int usec, uint64_t *t_off, uint64_t *t_on);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif /* PCIBX_DEVICE_H_ */
@@ -0,0 +1,269 @@
+/*
+
+  Catalyst PCIBX32 PCI Extender control utility
+
+  Copyright (c) 2006-2009 Michael Buesch <mb@bu3sch.de>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Steet, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+
+*/
+
+#include "probe.h"
+#include "pcibx.h"
+#include "pcibx_device.h"
+#include "utils.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+
+
+/* Number of read verifications per step */
+#define PROBE_READS		32
+/* Number of measurement verifications per step */
+#define PROBE_MEASURES		2
+/* Max deviation of the +2.5V reference between two steps */
+#define PROBE_REF_TOLERANCE	0.01
+
+static const unsigned int strobe_steps[] = {
+	100, 70, 50, 35, 25, 20, 15, 10, 7, 5, 3, 2, 1, 0,
+};
+
+static const unsigned int write_ext_steps[] = {
+	2000, 1500, 1000, 700, 500, 350, 250, 150, 100, 50, 20, 10,
+};
+
+struct probe_ref {
+	uint8_t boardid;
+	uint8_t firmrev;
+	float v25ref;
+};
+
+/* Measure the +2.5V reference. This verifies the write of the
+ * multiplexer channel, the conversion strobe and the readout. */
+static int verify_measure(struct pcibx_device *dev,
+			  const struct probe_ref *ref)
+{
+	float v, diff;
+	int i;
+
+	for (i = 0; i < PROBE_MEASURES; i++) {
+		/* Force the channel to be selected again. */
+		pcibx_device_invalidate_measure(dev);
+		v = pcibx_cmd_measure(dev, MEASURE_V25REF);
+		diff = v - ref->v25ref;
+		if (diff < 0)
+			diff = -diff;
+		if (diff > ref->v25ref * PROBE_REF_TOLERANCE)
+			return 0;
+	}
+
+	return 1;
+}
+
+/* Alternate between two registers with known contents, so that
+ * a stale value on the data lines does not pass. */
+static int verify_reads(struct pcibx_device *dev,
+			const struct probe_ref *ref)
+{
+	int i;
+
+	for (i = 0; i < PROBE_READS; i++) {
+		if (pcibx_cmd_getboardid(dev) != ref->boardid)
+			return 0;
+		if (pcibx_cmd_getfirmrev(dev) != ref->firmrev)
+			return 0;
+	}
+
+	return 1;
+}
+
+static unsigned int add_margin(unsigned int usec, unsigned int max)
+{
+	unsigned int v;
+
+	v = usec + (usec * cmdargs.probe_margin + 99) / 100;
+	if (v < 1)
+		v = 1;
+	if (v > max)
+		v = max;
+
+	return v;
+}
+
+static int timing_store(const char *file, const char *port,
+			const struct probe_ref *ref,
+			unsigned int strobe, unsigned int write_ext)
+{
+	char line[512], name[256];
+	char *tmpfile;
+	FILE *in, *out;
+	int err = -1;
+
+	tmpfile = malloce(strlen(file) + 5);
+	sprintf(tmpfile, "%s.tmp", file);
+	out = fopen(tmpfile, "w");
+	if (!out) {
+		prerror("Could not create %s: %s\n", tmpfile, strerror(errno));
+		goto out_free;
+	}
+	/* Keep the entries of the other boards. */
+	in = fopen(file, "r");
+	if (in) {
+		while (fgets(line, sizeof(line), in)) {
+			if (sscanf(line, "%255s", name) == 1 &&
+			    strcmp(name, port) == 0)
+				continue;
+			fputs(line, out);
+		}
+		fclose(in);
+	}
+	fprintf(out, "%s strobe=%u write_ext=%u boardid=0x%02X firmrev=0x%02X\n",
+		port, strobe, write_ext, ref->boardid, ref->firmrev);
+	if (fclose(out)) {
+		prerror("Could not write %s: %s\n", tmpfile, strerror(errno));
+		goto out_free;
+	}
+	if (rename(tmpfile, file)) {
+		prerror("Could not rename %s to %s: %s\n",
+			tmpfile, file, strerror(errno));
+		goto out_free;
+	}
+	err = 0;
+out_free:
+	free(tmpfile);
+
+	return err;
+}
+
+int timing_load(struct pcibx_device *dev, const char *file, int check_board)
+{
+	char line[512], name[256];
+	unsigned int strobe, write_ext, boardid, firmrev;
+	uint8_t live_boardid, live_firmrev;
+	FILE *f;
+
+	f = fopen(file, "r");
+	if (!f) {
+		prerror("Could not open %s: %s\n", file, strerror(errno));
+		return -1;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "%255s strobe=%u write_ext=%u boardid=%x firmrev=%x",
+			   name, &strobe, &write_ext, &boardid, &firmrev) != 5)
+			continue;
+		if (strcmp(name, dev->port) != 0)
+			continue;
+		fclose(f);
+		if (check_board) {
+			/* Still at the default timing */
+			live_boardid = pcibx_cmd_getboardid(dev);
+			live_firmrev = pcibx_cmd_getfirmrev(dev);
+			if (live_boardid != boardid || live_firmrev != firmrev) {
+				prerror("%s: The timing in %s was probed on board "
+					"0x%02X firmware 0x%02X, but board 0x%02X "
+					"firmware 0x%02X is connected. Using the "
+					"defaults.\n", dev->port, file, boardid,
+					firmrev, live_boardid, live_firmrev);
+				return 0;
+			}
+		}
+		pcibx_device_set_timing(dev, strobe, write_ext);
+		if (cmdargs.verbose >= 1) {
+			prinfo("%s: strobe %u usec, write_ext %u usec\n",
+			       dev->port, strobe, write_ext);
+		}
+		return 0;
+	}
+	fclose(f);
+	if (cmdargs.verbose >= 1)
+		prinfo("%s: No stored timing in %s. Using the defaults.\n",
+		       dev->port, file);
+
+	return 0;
+}
+
+int probe_run(struct pcibx_device *dev)
+{
+	const unsigned int default_ext = PCIBX_WRITE_EXT_MSEC * 1000;
+	unsigned int strobe = PCIBX_STROBE_USEC, write_ext = default_ext;
+	struct probe_ref ref;
+	int i;
+
+	/* Reference values at the default timing */
+	pcibx_device_set_timing(dev, PCIBX_STROBE_USEC, default_ext);
+	ref.boardid = pcibx_cmd_getboardid(dev);
+	ref.firmrev = pcibx_cmd_getfirmrev(dev);
+	pcibx_device_invalidate_measure(dev);
+	ref.v25ref = pcibx_cmd_measure(dev, MEASURE_V25REF);
+	prinfo("Board ID 0x%02X, firmware 0x%02X, +2.5V reference %f Volt\n",
+	       ref.boardid, ref.firmrev, ref.v25ref);
+	if (ref.boardid == ref.firmrev || ref.v25ref < 1.0) {
+		prerror("The board does not respond at the default timing.\n");
+		return -1;
+	}
+	/* A misdecoded address at a too short strobe may hit the
+	 * power registers. Only probe with the UUT switched off. */
+	if (pcibx_cmd_getstatus(dev) & PCIBX_STATUS_RSTDEASS) {
+		prerror("The UUT is powered. Switch it off with "
+			"--cmd-uut OFF before probing.\n");
+		return -1;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(strobe_steps) && !terminate; i++) {
+		pcibx_device_set_timing(dev, strobe_steps[i], default_ext);
+		/* Do not write at a width that fails to read. */
+		if (!verify_reads(dev, &ref)) {
+			prinfo("Strobe %3u usec: FAILED (read)\n", strobe_steps[i]);
+			break;
+		}
+		if (!verify_measure(dev, &ref)) {
+			prinfo("Strobe %3u usec: FAILED\n", strobe_steps[i]);
+			break;
+		}
+		prinfo("Strobe %3u usec: ok\n", strobe_steps[i]);
+		strobe = strobe_steps[i];
+	}
+	strobe = add_margin(strobe, PCIBX_STROBE_USEC);
+
+	for (i = 0; i < ARRAY_SIZE(write_ext_steps) && !terminate; i++) {
+		pcibx_device_set_timing(dev, strobe, write_ext_steps[i]);
+		if (!verify_measure(dev, &ref)) {
+			prinfo("Slow strobe %4u usec: FAILED\n", write_ext_steps[i]);
+			break;
+		}
+		prinfo("Slow strobe %4u usec: ok\n", write_ext_steps[i]);
+		write_ext = write_ext_steps[i];
+	}
+	write_ext = add_margin(write_ext, default_ext);
+	if (terminate)
+		return -1;
+
+	/* Final check with the margin applied */
+	pcibx_device_set_timing(dev, strobe, write_ext);
+	if (!verify_reads(dev, &ref) || !verify_measure(dev, &ref)) {
+		prerror("Verification with strobe %u usec and slow strobe "
+			"%u usec failed. Keeping the defaults.\n",
+			strobe, write_ext);
+		pcibx_device_set_timing(dev, PCIBX_STROBE_USEC, default_ext);
+		return -1;
+	}
+	prinfo("Using strobe %u usec, slow strobe %u usec (%d%% margin)\n",
+	       strobe, write_ext, cmdargs.probe_margin);
+
+	return timing_store(cmdargs.probe_file, dev->port, &ref,
+			    strobe, write_ext);
+}
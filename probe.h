@@ -0,0 +1,38 @@
+/*
+
+  Catalyst PCIBX32 PCI Extender control utility
+
+  Copyright (c) 2006-2009 Michael Buesch <mb@bu3sch.de>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Steet, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+
+*/
+
+#ifndef PCIBX_PROBE_H_
+#define PCIBX_PROBE_H_
+
+struct pcibx_device;
+
+/* Find the shortest strobe widths that still work reliably and
+ * store them with the configured margin in cmdargs.probe_file. */
+int probe_run(struct pcibx_device *dev);
+
+/* Apply the strobe widths stored for the port of "dev" in "file".
+ * Keeps the default widths, if there is no entry for the port or,
+ * with "check_board", if another board is connected now. */
+int timing_load(struct pcibx_device *dev, const char *file, int check_board);
+
+#endif /* PCIBX_PROBE_H_ */
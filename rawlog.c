@@ -0,0 +1,167 @@
+/*
+
+  Catalyst PCIBX32 PCI Extender control utility
+
+  Copyright (c) 2006-2009 Michael Buesch <mb@bu3sch.de>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Steet, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+
+*/
+
+#include "rawlog.h"
+#include "pcibx_device.h"
+#include "utils.h"
+
+#include <string.h>
+#include <errno.h>
+
+
+/* Number of records converted at once */
+#define RAWLOG_BLOCK	4096
+
+struct rawlog * rawlog_create(const char *file)
+{
+	struct rawlog *r;
+
+	r = malloce(sizeof(*r));
+	memset(r, 0, sizeof(*r));
+	r->f = fopen(file, "wb");
+	if (!r->f) {
+		prerror("Could not create raw log %s: %s\n",
+			file, strerror(errno));
+		free(r);
+		return NULL;
+	}
+	setvbuf(r->f, NULL, _IOFBF, 65536);
+	fwrite(RAWLOG_MAGIC, 8, 1, r->f);
+
+	return r;
+}
+
+void rawlog_close(struct rawlog *r)
+{
+	if (!r)
+		return;
+	if (fclose(r->f))
+		prerror("Could not write the raw log: %s\n", strerror(errno));
+	free(r);
+}
+
+void rawlog_write(struct rawlog *r, int channel, uint16_t code)
+{
+	struct rawlog_record rec;
+	uint64_t now, delta;
+
+	now = monotonic_nsec();
+	delta = r->last ? (now - r->last) / 1000 : 0;
+	if (delta > UINT32_MAX)
+		delta = UINT32_MAX;
+	r->last = now;
+
+	rec.delta = delta;
+	rec.channel = channel;
+	rec.reserved = 0;
+	rec.code = code;
+	fwrite(&rec, sizeof(rec), 1, r->f);
+	r->nr_records++;
+}
+
+struct convert_block {
+	struct rawlog_record rec[RAWLOG_BLOCK];
+	/* Codes and values of one channel, in record order */
+	uint16_t codes[RAWLOG_BLOCK];
+	float values[RAWLOG_BLOCK];
+	/* Converted value of each record */
+	float result[RAWLOG_BLOCK];
+};
+
+/* Convert all records of a block. The codes are gathered per
+ * channel, so that each channel is converted in one batch. */
+static void convert_block(struct convert_block *b, size_t count)
+{
+	size_t i, n;
+	int ch;
+
+	for (ch = MEASURE_V25REF; ch <= MEASURE_A33; ch++) {
+		for (i = 0, n = 0; i < count; i++) {
+			if (b->rec[i].channel == ch)
+				b->codes[n++] = b->rec[i].code;
+		}
+		if (!n)
+			continue;
+		pcibx_measure_convert(ch, b->codes, b->values, n);
+		for (i = 0, n = 0; i < count; i++) {
+			if (b->rec[i].channel == ch)
+				b->result[i] = b->values[n++];
+		}
+	}
+}
+
+int rawlog_convert(const char *file)
+{
+	struct convert_block *b;
+	char magic[8];
+	uint64_t t = 0;
+	size_t i, count;
+	FILE *f;
+	int err = 0;
+
+	f = fopen(file, "rb");
+	if (!f) {
+		prerror("Could not open raw log %s: %s\n",
+			file, strerror(errno));
+		return -1;
+	}
+	if (fread(magic, 8, 1, f) != 1 ||
+	    memcmp(magic, RAWLOG_MAGIC, 8) != 0) {
+		prerror("%s is not a raw log\n", file);
+		fclose(f);
+		return -1;
+	}
+
+	b = malloce(sizeof(*b));
+	while ((count = fread(b->rec, sizeof(b->rec[0]), RAWLOG_BLOCK, f))) {
+		for (i = 0; i < count; i++) {
+			if (b->rec[i].channel < MEASURE_V25REF ||
+			    b->rec[i].channel > MEASURE_A33) {
+				prerror("%s: Invalid channel %u\n",
+					file, b->rec[i].channel);
+				err = -1;
+				goto out;
+			}
+		}
+		convert_block(b, count);
+		for (i = 0; i < count; i++) {
+			t += b->rec[i].delta;
+			prinfo("%lu.%06lu %-7s %f %s\n",
+			       (unsigned long)(t / 1000000),
+			       (unsigned long)(t % 1000000),
+			       pcibx_measure_name(b->rec[i].channel),
+			       b->result[i],
+			       pcibx_measure_is_current(b->rec[i].channel) ?
+						"Ampere" : "Volt");
+		}
+	}
+	if (ferror(f)) {
+		prerror("Could not read %s: %s\n", file, strerror(errno));
+		err = -1;
+	}
+out:
+	free(b);
+	fclose(f);
+
+	return err;
+}
@@ -0,0 +1,55 @@
+/*
+
+  Catalyst PCIBX32 PCI Extender control utility
+
+  Copyright (c) 2006-2009 Michael Buesch <mb@bu3sch.de>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Steet, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+
+*/
+
+#ifndef PCIBX_RAWLOG_H_
+#define PCIBX_RAWLOG_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Raw ADC code log file format:
+ * An 8 byte header "PCIBXRW1", followed by struct rawlog_record
+ * entries in host byte order. */
+#define RAWLOG_MAGIC		"PCIBXRW1"
+
+struct rawlog_record {
+	uint32_t delta;		/* usec since the previous record */
+	uint8_t channel;	/* enum measure_id */
+	uint8_t reserved;
+	uint16_t code;		/* 12-bit ADC code */
+} __attribute__((packed));
+
+struct rawlog {
+	FILE *f;
+	uint64_t last;		/* CLOCK_MONOTONIC nsec of the last record */
+	unsigned long nr_records;
+};
+
+struct rawlog * rawlog_create(const char *file);
+void rawlog_close(struct rawlog *r);
+void rawlog_write(struct rawlog *r, int channel, uint16_t code);
+
+/* Convert a raw log to Volt/Ampere and print it. */
+int rawlog_convert(const char *file);
+
+#endif /* PCIBX_RAWLOG_H_ */
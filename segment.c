@@ -0,0 +1,163 @@
+/*
+
+  Catalyst PCIBX32 PCI Extender control utility
+
+  Copyright (c) 2006-2009 Michael Buesch <mb@bu3sch.de>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Steet, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+
+*/
+
+#include "segment.h"
+#include "utils.h"
+
+#include <string.h>
+
+
+void segment_init(struct segmenter *s, const char *name, double step)
+{
+	memset(s, 0, sizeof(*s));
+	s->name = name;
+	/* Tuned for the step size: The slack is half of the step and
+	 * a step is detected after about 8 samples. */
+	s->k = step / 2.0;
+	s->h = step * 4.0;
+}
+
+static void acc_add(struct segment_acc *a, double power,
+		    double joules, uint64_t time)
+{
+	if (!a->n)
+		a->start = time;
+	a->n++;
+	a->sum += power;
+	a->joules += joules;
+}
+
+static void acc_sub(struct segment_acc *a, const struct segment_acc *b)
+{
+	a->n -= b->n;
+	a->sum -= b->sum;
+	a->joules -= b->joules;
+}
+
+static void print_segment(struct segmenter *s, const struct segment_acc *a,
+			  uint64_t end, int open)
+{
+	s->nr_segments++;
+	prinfo("%s%sSegment %u: %.3f - %.3f sec, %lu samples, %.3f W, %.3f J%s\n",
+	       s->name ? s->name : "", s->name ? ": " : "",
+	       s->nr_segments,
+	       (a->start - s->t0) / 1000000000.0,
+	       (end - s->t0) / 1000000000.0,
+	       a->n, a->n ? a->sum / a->n : 0.0, a->joules,
+	       open ? " (open)" : "");
+}
+
+/* A change was detected. The samples in "tail" start the new segment. */
+static void change(struct segmenter *s, const struct segment_acc *tail)
+{
+	struct segment_acc next = *tail;
+
+	acc_sub(&s->seg, tail);
+	print_segment(s, &s->seg, tail->start, 0);
+	s->seg = next;
+	memset(&s->hi, 0, sizeof(s->hi));
+	memset(&s->lo, 0, sizeof(s->lo));
+	s->s_hi = 0.0;
+	s->s_lo = 0.0;
+}
+
+static void cusum(struct segmenter *s, double power,
+		  double joules, uint64_t time)
+{
+	const struct segment_acc *tail;
+	double mean;
+
+	acc_add(&s->seg, power, joules, time);
+	if (s->seg.n < SEGMENT_MIN_SAMPLES)
+		return;
+	/* The reference is the mean of the segment without the
+	 * samples that are suspected to belong to the next one. */
+	tail = s->s_hi > s->s_lo ? &s->hi : &s->lo;
+	mean = (s->seg.sum - tail->sum) / (s->seg.n - tail->n);
+
+	s->s_hi += power - mean - s->k;
+	if (s->s_hi <= 0.0) {
+		s->s_hi = 0.0;
+		memset(&s->hi, 0, sizeof(s->hi));
+	} else {
+		acc_add(&s->hi, power, joules, time);
+	}
+	s->s_lo += mean - power - s->k;
+	if (s->s_lo <= 0.0) {
+		s->s_lo = 0.0;
+		memset(&s->lo, 0, sizeof(s->lo));
+	} else {
+		acc_add(&s->lo, power, joules, time);
+	}
+
+	if (s->s_hi > s->h)
+		change(s, &s->hi);
+	else if (s->s_lo > s->h)
+		change(s, &s->lo);
+}
+
+void segment_sample(struct segmenter *s, enum measure_id id,
+		    float value, uint64_t time)
+{
+	double power = 0.0, joules = 0.0;
+	int i, have = 0;
+
+	for (i = 0; i < PCIBX_NR_RAILS; i++) {
+		if (pcibx_rails[i].volt == id) {
+			s->rail[i].volt = value;
+			s->rail[i].have_volt = 1;
+		}
+		if (pcibx_rails[i].amp == id) {
+			s->rail[i].amp = value;
+			s->rail[i].have_amp = 1;
+		}
+	}
+	/* The voltages only scale the power. The load changes
+	 * show up in the currents, so only they make a new point. */
+	if (!pcibx_measure_is_current(id))
+		return;
+	for (i = 0; i < PCIBX_NR_RAILS; i++) {
+		if (s->rail[i].have_volt && s->rail[i].have_amp) {
+			power += (double)s->rail[i].volt * s->rail[i].amp;
+			have = 1;
+		}
+	}
+	if (!have)
+		return;
+
+	if (s->time && time > s->time) {
+		joules = (power + s->power) / 2.0 *
+			 (double)(time - s->time) / 1000000000.0;
+	}
+	if (!s->t0)
+		s->t0 = time;
+	s->power = power;
+	s->time = time;
+	cusum(s, power, joules, time);
+}
+
+void segment_finish(struct segmenter *s)
+{
+	if (s->seg.n)
+		print_segment(s, &s->seg, s->time, 1);
+}
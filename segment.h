@@ -0,0 +1,75 @@
+/*
+
+  Catalyst PCIBX32 PCI Extender control utility
+
+  Copyright (c) 2006-2009 Michael Buesch <mb@bu3sch.de>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Steet, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+
+*/
+
+#ifndef PCIBX_SEGMENT_H_
+#define PCIBX_SEGMENT_H_
+
+#include "pcibx_device.h"
+
+#include <stdint.h>
+
+/* Minimum number of samples to estimate the mean of a segment,
+ * before changes are detected. */
+#define SEGMENT_MIN_SAMPLES	8
+
+struct segment_acc {
+	unsigned long n;
+	double sum;		/* of the power samples */
+	double joules;
+	uint64_t start;		/* CLOCK_MONOTONIC nsec of the first sample */
+};
+
+/* Online segmentation of the total UUT power into intervals of
+ * constant load, using a two sided CUSUM change detector. */
+struct segmenter {
+	const char *name;	/* Printed before each segment, or NULL */
+	double k;		/* CUSUM slack, W */
+	double h;		/* CUSUM threshold, W */
+
+	struct {
+		float volt;
+		float amp;
+		int have_volt;
+		int have_amp;
+	} rail[PCIBX_NR_RAILS];
+	double power;		/* The previous power point */
+	uint64_t time;		/* CLOCK_MONOTONIC nsec, 0 = none */
+	uint64_t t0;		/* Time of the first power point */
+
+	struct segment_acc seg;	/* The current segment */
+	/* Samples since the upper/lower CUSUM was last zero.
+	 * These move to the next segment on a change. */
+	struct segment_acc hi, lo;
+	double s_hi, s_lo;
+	unsigned int nr_segments;
+};
+
+/* "step" is the smallest power change in Watt to detect. */
+void segment_init(struct segmenter *s, const char *name, double step);
+/* Feed a measurement taken at "time" (CLOCK_MONOTONIC nsec). */
+void segment_sample(struct segmenter *s, enum measure_id id,
+		    float value, uint64_t time);
+/* Print the last (still open) segment. */
+void segment_finish(struct segmenter *s);
+
+#endif /* PCIBX_SEGMENT_H_ */
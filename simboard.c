@@ -0,0 +1,146 @@
+/*
+
+  Catalyst PCIBX32 PCI Extender control utility
+
+  Copyright (c) 2006-2009 Michael Buesch <mb@bu3sch.de>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Steet, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+
+*/
+#include "simboard.h"
+#include "utils.h"
+
+#include <string.h>
+
+
+#define SIM_REG(addr)	((addr) & 0x7F)	/* PCI1 and PCI2 */
+
+void pcibx_sim_init(struct pcibx_sim *sim)
+{
+	uint32_t freq = 33.333 * 1048575.0 / 100.0;
+	int i;
+
+	memset(sim, 0, sizeof(*sim));
+	sim->regs[PCIBX_REG_FIRMREV] = 0x13;
+	sim->regs[PCIBX_REG_BOARDID] = 0x42;
+	sim->regs[PCIBX_REG_UUTVOLT] = 1;
+	sim->regs[PCIBX_REG_AUX5V] = 1;
+	sim->regs[PCIBX_REG_AUX33V] = 1;
+	sim->regs[PCIBX_REG_STATUS] = PCIBX_STATUS_32BIT;
+	sim->regs[PCIBX_REG_FREQMEASURE_0] = freq;
+	sim->regs[PCIBX_REG_FREQMEASURE_1] = freq >> 8;
+	sim->regs[PCIBX_REG_FREQMEASURE_2] = freq >> 16;
+	for (i = 0; i < PCIBX_NR_MEASURE; i++)
+		sim->codes[i] = 1000 + i * 100;
+	sim->ctl = 0xE;
+}
+
+static void sim_write_reg(struct pcibx_sim *sim, uint8_t reg, uint8_t value)
+{
+	uint8_t *status = &sim->regs[PCIBX_REG_STATUS];
+
+	sim->regs[reg] = value;
+	switch (reg) {
+	case PCIBX_REG_GLOBALPWR:
+		if (!value)
+			*status &= ~(PCIBX_STATUS_RSTDEASS | PCIBX_STATUS_DUTASS);
+		break;
+	case PCIBX_REG_UUTVOLT:
+		if (value)
+			*status &= ~(PCIBX_STATUS_RSTDEASS | PCIBX_STATUS_DUTASS);
+		else
+			*status |= PCIBX_STATUS_RSTDEASS | PCIBX_STATUS_DUTASS;
+		break;
+	}
+}
+
+static uint8_t sim_read_reg(struct pcibx_sim *sim, uint8_t reg)
+{
+	uint8_t sel = sim->regs[PCIBX_REG_MEASURE_CTL];
+	uint16_t code = 0;
+
+	if (sel >= MEASURE_V25REF && sel < MEASURE_V25REF + PCIBX_NR_MEASURE)
+		code = sim->codes[MEASURE_INDEX(sel)];
+	switch (reg) {
+	case PCIBX_REG_MEASURE_DATA0:
+		return code & 0xFF;
+	case PCIBX_REG_MEASURE_DATA1:
+		return code >> 8;
+	}
+	return sim->regs[reg];
+}
+
+static int sim_open(struct pcibx_device *dev, const char *port)
+{
+	if (!dev->backend_priv) {
+		prerror("The sim backend needs a struct pcibx_sim\n");
+		return -1;
+	}
+	return 0;
+}
+
+static void sim_close(struct pcibx_device *dev)
+{
+}
+
+static int sim_read_data(struct pcibx_device *dev, uint8_t *value)
+{
+	struct pcibx_sim *sim = dev->backend_priv;
+
+	sim->nr_reads++;
+	if (sim->ctl & PPCTL_READ)
+		*value = sim_read_reg(sim, SIM_REG(sim->addr));
+	else
+		*value = sim->data;
+	return 0;
+}
+
+static int sim_write_data(struct pcibx_device *dev, uint8_t value)
+{
+	struct pcibx_sim *sim = dev->backend_priv;
+
+	sim->nr_writes++;
+	sim->data = value;
+	return 0;
+}
+
+/* 0xE -> 0x6 is the address strobe, 0xE -> 0xC the data strobe. */
+static int sim_write_control(struct pcibx_device *dev,
+			     uint8_t mask, uint8_t value)
+{
+	struct pcibx_sim *sim = dev->backend_priv;
+	uint8_t old = sim->ctl & PPCTL_DATAMASK;
+	uint8_t new;
+
+	sim->nr_ctl_writes++;
+	sim->ctl = (sim->ctl & ~mask) | (value & mask);
+	new = sim->ctl & PPCTL_DATAMASK;
+	if (old == 0xE && new == 0x6)
+		sim->addr = sim->data;
+	if (old == 0xE && new == 0xC)
+		sim_write_reg(sim, SIM_REG(sim->addr), sim->data);
+	return 0;
+}
+
+const struct pcibx_backend pcibx_backend_sim = {
+	.name		= "sim",
+	.open		= sim_open,
+	.close		= sim_close,
+	.read_data	= sim_read_data,
+	.write_data	= sim_write_data,
+	.write_control	= sim_write_control,
+	.virtual_time	= 1,
+};
@@ -0,0 +1,63 @@
+/*
+
+  Catalyst PCIBX32 PCI Extender control utility
+
+  Copyright (c) 2006-2009 Michael Buesch <mb@bu3sch.de>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Steet, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+
+*/
+#ifndef PCIBX_SIMBOARD_H_
+#define PCIBX_SIMBOARD_H_
+
+#include "pcibx_device.h"
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A simulated extender board behind the parport protocol,
+ * for testing without hardware. Pass it as "priv" to
+ * pcibx_device_init_backend() with pcibx_backend_sim. */
+struct pcibx_sim {
+	uint8_t regs[0x80];
+	/* ADC code of every measurement channel */
+	uint16_t codes[PCIBX_NR_MEASURE];
+
+	/* Port state */
+	uint8_t data;
+	uint8_t ctl;
+	uint8_t addr;
+
+	/* Port accesses, as an ioctl counter would see them. */
+	unsigned long nr_reads;
+	unsigned long nr_writes;
+	unsigned long nr_ctl_writes;
+};
+
+/* Set up a powered down board with plausible readings. */
+PCIBX_API void pcibx_sim_init(struct pcibx_sim *sim);
+
+/* Backend that drives a struct pcibx_sim. The port is ignored. */
+PCIBX_API extern const struct pcibx_backend pcibx_backend_sim;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PCIBX_SIMBOARD_H_ */
@@ -0,0 +1,80 @@
+/*
+
+  Catalyst PCIBX32 PCI Extender control utility
+
+  Copyright (c) 2006-2009 Michael Buesch <mb@bu3sch.de>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Steet, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+
+*/
+
+#include "spsc.h"
+#include "utils.h"
+
+#include <string.h>
+
+
+struct spsc_ring * spsc_create(unsigned int size, size_t elem_size)
+{
+	struct spsc_ring *r;
+	unsigned int n = 1;
+
+	while (n < size)
+		n <<= 1;
+	r = malloce(sizeof(*r));
+	memset(r, 0, sizeof(*r));
+	r->mask = n - 1;
+	r->elem_size = elem_size;
+	r->buf = malloce(n * elem_size);
+
+	return r;
+}
+
+void spsc_destroy(struct spsc_ring *r)
+{
+	if (!r)
+		return;
+	free(r->buf);
+	free(r);
+}
+
+int spsc_push(struct spsc_ring *r, const void *elem)
+{
+	unsigned int head = r->head;
+	unsigned int tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+
+	if (head - tail > r->mask)
+		return -1;
+	memcpy(r->buf + (head & r->mask) * r->elem_size, elem, r->elem_size);
+	/* Publish the element after it is written. */
+	__atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+int spsc_pop(struct spsc_ring *r, void *elem)
+{
+	unsigned int tail = r->tail;
+	unsigned int head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+
+	if (head == tail)
+		return -1;
+	memcpy(elem, r->buf + (tail & r->mask) * r->elem_size, r->elem_size);
+	/* Release the slot after it is read. */
+	__atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
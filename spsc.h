@@ -0,0 +1,53 @@
+/*
+
+  Catalyst PCIBX32 PCI Extender control utility
+
+  Copyright (c) 2006-2009 Michael Buesch <mb@bu3sch.de>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Steet, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+
+*/
+
+#ifndef PCIBX_SPSC_H_
+#define PCIBX_SPSC_H_
+
+#include <stddef.h>
+
+/* Lock-free single producer / single consumer ring buffer
+ * of fixed size elements. One thread may push while
+ * another thread pops, without any locking. */
+struct spsc_ring {
+	/* Written by the producer only. */
+	unsigned int head;
+	/* Written by the consumer only. */
+	unsigned int tail __attribute__((aligned(64)));
+
+	unsigned int mask;
+	size_t elem_size;
+	char *buf;
+};
+
+/* "size" is rounded up to a power of two. */
+struct spsc_ring * spsc_create(unsigned int size, size_t elem_size);
+void spsc_destroy(struct spsc_ring *r);
+
+/* Returns 0 on success or -1, if the ring is full.
+ * The element is not queued then. */
+int spsc_push(struct spsc_ring *r, const void *elem);
+/* Returns 0 on success or -1, if the ring is empty. */
+int spsc_pop(struct spsc_ring *r, void *elem);
+
+#endif /* PCIBX_SPSC_H_ */
@@ -0,0 +1,146 @@
+/*
+
+  Catalyst PCIBX32 PCI Extender control utility
+
+  Copyright (c) 2006-2009 Michael Buesch <mb@bu3sch.de>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Steet, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+
+*/
+
+#include "stress.h"
+#include "pcibx.h"
+#include "pcibx_device.h"
+#include "histogram.h"
+#include "utils.h"
+
+#include <string.h>
+
+
+struct stress_stats {
+	unsigned int cycles;
+	unsigned int rst_timeouts;
+	unsigned int no_handshake;
+	unsigned int handshake_32bit;
+	unsigned int handshake_64bit;
+	struct histogram rst_latency;	/* usec */
+	struct histogram peak_current;	/* mA */
+};
+
+/* Poll the status until RST# is de-asserted.
+ * Returns the status and the time of the de-assertion in *t. */
+static uint8_t wait_rst_deassert(struct pcibx_device *dev,
+				 uint64_t t0, uint64_t timeout,
+				 uint64_t *t)
+{
+	uint8_t status;
+
+	while (1) {
+		status = pcibx_cmd_getstatus(dev);
+		*t = monotonic_nsec();
+		if (status & PCIBX_STATUS_RSTDEASS)
+			break;
+		if (*t - t0 >= timeout)
+			break;
+	}
+
+	return status;
+}
+
+static void stress_cycle(struct pcibx_device *dev,
+			 struct stress_stats *st)
+{
+	uint64_t t0, t_rst, end;
+	uint8_t status;
+	float a, peak = 0.0;
+	int channel = cmdargs.stress_channel;
+
+	pcibx_cmd_uut_pwr_nowait(dev, 0);
+	msleep(cmdargs.stress_off);
+
+	pcibx_cmd_clearbitstat(dev);
+	t0 = monotonic_nsec();
+	pcibx_cmd_uut_pwr_nowait(dev, 1);
+	status = wait_rst_deassert(dev, t0,
+				   (uint64_t)cmdargs.stress_timeout * 1000000,
+				   &t_rst);
+
+	/* Sample the current for the rest of the ON dwell time. */
+	end = t0 + (uint64_t)cmdargs.stress_on * 1000000;
+	do {
+		if (channel < 0) {
+			if (monotonic_nsec() < end)
+				msleep((end - monotonic_nsec()) / 1000000);
+			break;
+		}
+		a = pcibx_cmd_measure(dev, channel);
+		if (a > peak)
+			peak = a;
+	} while (monotonic_nsec() < end);
+	if (status & PCIBX_STATUS_RSTDEASS)
+		status = pcibx_cmd_getstatus(dev);
+
+	st->cycles++;
+	prinfo("Cycle %u: ", st->cycles);
+	if (status & PCIBX_STATUS_RSTDEASS) {
+		histogram_add(&st->rst_latency, (t_rst - t0) / 1000);
+		prinfo("RST# de-asserted after %.3f msec", (t_rst - t0) / 1000000.0);
+	} else {
+		st->rst_timeouts++;
+		prinfo("RST# TIMEOUT");
+	}
+	if (status & PCIBX_STATUS_64BIT) {
+		st->handshake_64bit++;
+		prinfo(", 64-bit");
+	} else if (status & PCIBX_STATUS_32BIT) {
+		st->handshake_32bit++;
+		prinfo(", 32-bit");
+	} else {
+		st->no_handshake++;
+		prinfo(", NO handshake");
+	}
+	if (channel >= 0) {
+		histogram_add(&st->peak_current, (uint64_t)(peak * 1000.0 + 0.5));
+		prinfo(", peak %s %f Ampere", pcibx_measure_name(channel), peak);
+	}
+	prinfo("\n");
+}
+
+int stress_run(struct pcibx_device *dev)
+{
+	struct stress_stats *st;
+	unsigned int failures;
+
+	st = malloce(sizeof(*st));
+	memset(st, 0, sizeof(*st));
+	histogram_init(&st->rst_latency);
+	histogram_init(&st->peak_current);
+
+	while (!terminate && (int)st->cycles < cmdargs.stress_cycles)
+		stress_cycle(dev, st);
+
+	failures = st->rst_timeouts + st->no_handshake;
+	prinfo("\n%u power cycles, %u failures (%u RST# timeouts, "
+	       "%u without handshake), %u 32-bit, %u 64-bit\n",
+	       st->cycles, failures, st->rst_timeouts, st->no_handshake,
+	       st->handshake_32bit, st->handshake_64bit);
+	histogram_print(&st->rst_latency, "Time to RST# de-assert", "usec");
+	if (cmdargs.stress_channel >= 0)
+		histogram_print(&st->peak_current, "Peak current", "mA");
+	free(st);
+
+	return failures ? -1 : 0;
+}
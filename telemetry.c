@@ -0,0 +1,206 @@
+/*
+
+  Catalyst PCIBX32 PCI Extender control utility
+
+  Copyright (c) 2006-2009 Michael Buesch <mb@bu3sch.de>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Steet, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+
+*/
+
+#include "telemetry.h"
+#include "utils.h"
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+static void telemetry_init(struct pcibx_telemetry *t)
+{
+	memset(t, 0, sizeof(*t));
+	t->version = PCIBX_TELEMETRY_VERSION;
+	t->pid = getpid();
+	/* Publish the magic last, so readers never see a half
+	 * initialized segment. */
+	__atomic_store_n(&t->magic, PCIBX_TELEMETRY_MAGIC, __ATOMIC_RELEASE);
+}
+
+/* Create the telemetry segment. If name is NULL, the segment
+ * is process private and not visible to other processes. */
+struct pcibx_telemetry * telemetry_create(const char *name)
+{
+	struct pcibx_telemetry *t;
+	int fd;
+
+	if (!name) {
+		t = malloce(sizeof(*t));
+		telemetry_init(t);
+		return t;
+	}
+
+	fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+	if (fd < 0) {
+		prerror("Could not create shared memory segment %s: %s\n",
+			name, strerror(errno));
+		return NULL;
+	}
+	if (ftruncate(fd, sizeof(*t))) {
+		prerror("Could not resize shared memory segment %s: %s\n",
+			name, strerror(errno));
+		goto err_close;
+	}
+	t = mmap(NULL, sizeof(*t), PROT_READ | PROT_WRITE,
+		 MAP_SHARED, fd, 0);
+	if (t == MAP_FAILED) {
+		prerror("Could not map shared memory segment %s: %s\n",
+			name, strerror(errno));
+		goto err_close;
+	}
+	close(fd);
+	telemetry_init(t);
+
+	return t;
+
+err_close:
+	close(fd);
+	shm_unlink(name);
+	return NULL;
+}
+
+void telemetry_destroy(struct pcibx_telemetry *t, const char *name)
+{
+	if (!t)
+		return;
+	if (!name) {
+		free(t);
+		return;
+	}
+	munmap(t, sizeof(*t));
+	shm_unlink(name);
+}
+
+static void telemetry_write_begin(struct pcibx_telemetry *t)
+{
+	__atomic_store_n(&t->seq, t->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void telemetry_write_end(struct pcibx_telemetry *t)
+{
+	__atomic_store_n(&t->seq, t->seq + 1, __ATOMIC_RELEASE);
+}
+
+static void telemetry_update(struct pcibx_telemetry *t,
+			     struct pcibx_telemetry_sample *s,
+			     float value)
+{
+	uint64_t now = monotonic_nsec();
+
+	telemetry_write_begin(t);
+	s->time = now;
+	s->count++;
+	s->value = value;
+	telemetry_write_end(t);
+}
+
+void telemetry_update_measure(struct pcibx_telemetry *t,
+			      enum measure_id id, float value)
+{
+	if (t)
+		telemetry_update(t, &t->measure[MEASURE_INDEX(id)], value);
+}
+
+void telemetry_update_sysfreq(struct pcibx_telemetry *t, float mhz)
+{
+	if (t)
+		telemetry_update(t, &t->sysfreq, mhz);
+}
+
+void telemetry_update_status(struct pcibx_telemetry *t, uint8_t status)
+{
+	if (t)
+		telemetry_update(t, &t->status, status);
+}
+
+void telemetry_update_pme(struct pcibx_telemetry *t, uint8_t pme)
+{
+	if (t)
+		telemetry_update(t, &t->pme, pme);
+}
+
+const struct pcibx_telemetry * telemetry_attach(const char *name)
+{
+	const struct pcibx_telemetry *t;
+	int fd;
+
+	fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0) {
+		prerror("Could not open shared memory segment %s: %s\n",
+			name, strerror(errno));
+		return NULL;
+	}
+	t = mmap(NULL, sizeof(*t), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (t == MAP_FAILED) {
+		prerror("Could not map shared memory segment %s: %s\n",
+			name, strerror(errno));
+		return NULL;
+	}
+	if (__atomic_load_n(&t->magic, __ATOMIC_ACQUIRE) != PCIBX_TELEMETRY_MAGIC ||
+	    t->version != PCIBX_TELEMETRY_VERSION) {
+		prerror("Shared memory segment %s is not a "
+			"pcibx telemetry segment\n", name);
+		munmap((void *)t, sizeof(*t));
+		return NULL;
+	}
+
+	return t;
+}
+
+void telemetry_detach(const struct pcibx_telemetry *t)
+{
+	if (t)
+		munmap((void *)t, sizeof(*t));
+}
+
+/* Take a consistent copy of the segment without blocking the writer.
+ * Returns 0 on success or -1, if the writer kept updating
+ * the segment for too long. */
+int telemetry_snapshot(const struct pcibx_telemetry *t,
+		       struct pcibx_telemetry *snapshot)
+{
+	uint32_t seq0, seq1;
+	int tries;
+
+	for (tries = 0; tries < 1000; tries++) {
+		seq0 = __atomic_load_n(&t->seq, __ATOMIC_ACQUIRE);
+		if (seq0 & 1)
+			continue;
+		memcpy(snapshot, t, sizeof(*snapshot));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		seq1 = __atomic_load_n(&t->seq, __ATOMIC_RELAXED);
+		if (seq0 == seq1) {
+			snapshot->seq = seq0;
+			return 0;
+		}
+	}
+
+	return -1;
+}
@@ -0,0 +1,74 @@
+/*
+
+  Catalyst PCIBX32 PCI Extender control utility
+
+  Copyright (c) 2006-2009 Michael Buesch <mb@bu3sch.de>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Steet, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+
+*/
+
+#ifndef PCIBX_TELEMETRY_H_
+#define PCIBX_TELEMETRY_H_
+
+#include "pcibx_device.h"
+
+#include <stdint.h>
+
+#define PCIBX_TELEMETRY_MAGIC		0x58424350 /* "PCBX" */
+#define PCIBX_TELEMETRY_VERSION		1
+
+struct pcibx_telemetry_sample {
+	/* CLOCK_MONOTONIC time of the sample in nsec. 0 = never sampled. */
+	uint64_t time;
+	uint32_t count;
+	float value;
+};
+
+/* The live telemetry segment.
+ * The writer increments "seq" before and after each update,
+ * so it is odd while an update is in progress (seqlock).
+ * Readers must use telemetry_snapshot() to get a consistent copy.
+ */
+struct pcibx_telemetry {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t seq;
+	uint32_t pid;
+
+	struct pcibx_telemetry_sample measure[PCIBX_NR_MEASURE];
+	struct pcibx_telemetry_sample sysfreq;
+	struct pcibx_telemetry_sample status;
+	struct pcibx_telemetry_sample pme;
+};
+
+/* Writer side */
+struct pcibx_telemetry * telemetry_create(const char *name);
+void telemetry_destroy(struct pcibx_telemetry *t, const char *name);
+
+void telemetry_update_measure(struct pcibx_telemetry *t,
+			      enum measure_id id, float value);
+void telemetry_update_sysfreq(struct pcibx_telemetry *t, float mhz);
+void telemetry_update_status(struct pcibx_telemetry *t, uint8_t status);
+void telemetry_update_pme(struct pcibx_telemetry *t, uint8_t pme);
+
+/* Reader side */
+const struct pcibx_telemetry * telemetry_attach(const char *name);
+void telemetry_detach(const struct pcibx_telemetry *t);
+int telemetry_snapshot(const struct pcibx_telemetry *t,
+		       struct pcibx_telemetry *snapshot);
+
+#endif /* PCIBX_TELEMETRY_H_ */
@@ -22,7 +22,6 @@
 */
 
 #include "utils.h"
-#include "pcibx.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -84,6 +83,20 @@ void msleep(unsigned int msecs)
 	}
 }
 
+/* Returns the CLOCK_MONOTONIC time in nanoseconds. */
+uint64_t monotonic_nsec(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts)) {
+		prerror("clock_gettime() failed with: %s\n",
+			strerror(errno));
+		return 0;
+	}
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
 int prinfo(const char *fmt, ...)
 {
 	int ret;
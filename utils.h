@@ -5,6 +5,8 @@
 #include <stdlib.h>
 #include <stdint.h>
 
+#define ARRAY_SIZE(x)		((int)(sizeof(x) / sizeof((x)[0])))
+
 #define pcibx_stringify_1(x)	#x
 #define pcibx_stringify(x)	pcibx_stringify_1(x)
 
@@ -33,4 +35,6 @@ void * realloce(void *ptr, size_t newsize);
 void udelay(unsigned int usecs);
 void msleep(unsigned int msecs);
 
+uint64_t monotonic_nsec(void);
+
 #endif /* PCIBX_UTILS_H_ */
@@ -0,0 +1,156 @@
+/*
+
+  Catalyst PCIBX32 PCI Extender control utility
+
+  Copyright (c) 2006-2009 Michael Buesch <mb@bu3sch.de>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Steet, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+
+*/
+
+#include "watchdog.h"
+#include "pcibx.h"
+#include "pcibx_device.h"
+#include "histogram.h"
+#include "utils.h"
+
+#include <string.h>
+
+
+/* Number of samples printed, when the watchdog trips. */
+#define WD_HISTORY	16
+
+struct wd_sample {
+	uint64_t time;		/* CLOCK_MONOTONIC nsec at the end of the conversion */
+	int channel;
+	float value;
+};
+
+struct wd_state {
+	struct wd_sample history[WD_HISTORY];
+	unsigned int nr_history;
+	unsigned long samples;
+	unsigned long fast_samples;
+	/* Time between two samples of the critical channel. */
+	struct histogram interval;	/* usec */
+};
+
+static int limit_violated(const struct wd_limit *limit, float value)
+{
+	if (limit->above)
+		return value > limit->value;
+	return value < limit->value;
+}
+
+static void print_sample(const struct wd_sample *s, uint64_t t0)
+{
+	prinfo("  %+10.3f msec  %-7s %f %s\n",
+	       ((double)s->time - (double)t0) / 1000000.0,
+	       pcibx_measure_name(s->channel), s->value,
+	       pcibx_measure_is_current(s->channel) ? "Ampere" : "Volt");
+}
+
+static void trip(struct pcibx_device *dev, struct wd_state *st,
+		 const struct wd_limit *limit,
+		 const struct wd_sample *s, uint64_t t_start)
+{
+	uint64_t t_cut;
+	unsigned int i, n;
+
+	/* Cut the power first. Everything else can wait. */
+	pcibx_cmd_uut_pwr_nowait(dev, 0);
+	t_cut = monotonic_nsec();
+
+	prerror("WATCHDOG: %s %f %s %c %f. UUT power cut.\n",
+		pcibx_measure_name(s->channel), s->value,
+		pcibx_measure_is_current(s->channel) ? "Ampere" : "Volt",
+		limit->above ? '>' : '<', limit->value);
+	prinfo("Reaction time: %.3f msec after the end of the conversion, "
+	       "%.3f msec after its start\n",
+	       (t_cut - s->time) / 1000000.0,
+	       (t_cut - t_start) / 1000000.0);
+	prinfo("Last samples (relative to the triggering sample):\n");
+	n = st->nr_history < WD_HISTORY ? st->nr_history : WD_HISTORY;
+	for (i = st->nr_history - n; i < st->nr_history; i++)
+		print_sample(&st->history[i % WD_HISTORY], s->time);
+}
+
+int watchdog_run(struct pcibx_device *dev)
+{
+	const struct wd_limit *limits = cmdargs.wd_limits;
+	const struct wd_limit *limit;
+	struct wd_state *st;
+	struct wd_sample *s;
+	uint64_t t_start, t_last = 0;
+	unsigned int slow = 0;
+	unsigned long n = 0;
+	int i, tripped = 0;
+
+	st = malloce(sizeof(*st));
+	memset(st, 0, sizeof(*st));
+	histogram_init(&st->interval);
+
+	prinfo("Watchdog armed on ");
+	for (i = 0; i < cmdargs.nr_wd_limits; i++) {
+		prinfo("%s%s%c%f", i ? ", " : "",
+		       pcibx_measure_name(limits[i].channel),
+		       limits[i].above ? '>' : '<', limits[i].value);
+	}
+	prinfo("\n");
+
+	while (!terminate) {
+		/* The first limit is the critical one. It is sampled
+		 * on every iteration, so the multiplexer stays on it
+		 * and the conversion does not wait for the input
+		 * to settle. The other limits are checked every
+		 * wd_ratio iterations only, because switching
+		 * the multiplexer away and back costs 2 * 10 msec. */
+		limit = &limits[0];
+		if (cmdargs.nr_wd_limits > 1 && n % cmdargs.wd_ratio == 0 && n) {
+			limit = &limits[1 + slow % (cmdargs.nr_wd_limits - 1)];
+			slow++;
+		}
+		n++;
+
+		s = &st->history[st->nr_history % WD_HISTORY];
+		t_start = monotonic_nsec();
+		s->value = pcibx_cmd_measure(dev, limit->channel);
+		s->time = monotonic_nsec();
+		s->channel = limit->channel;
+		st->nr_history++;
+		st->samples++;
+
+		if (limit == &limits[0]) {
+			if (t_last)
+				histogram_add(&st->interval, (s->time - t_last) / 1000);
+			t_last = s->time;
+			st->fast_samples++;
+		}
+		if (limit_violated(limit, s->value)) {
+			trip(dev, st, limit, s, t_start);
+			tripped = 1;
+			break;
+		}
+	}
+
+	prinfo("\n%lu samples, %lu on the critical channel %s\n",
+	       st->samples, st->fast_samples,
+	       pcibx_measure_name(limits[0].channel));
+	histogram_print(&st->interval, "Critical channel sample interval", "usec");
+	free(st);
+
+	return tripped ? -1 : 0;
+}
@@ -0,0 +1,33 @@
+/*
+
+  Catalyst PCIBX32 PCI Extender control utility
+
+  Copyright (c) 2006-2009 Michael Buesch <mb@bu3sch.de>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; see the file COPYING.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Steet, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+
+*/
+
+#ifndef PCIBX_WATCHDOG_H_
+#define PCIBX_WATCHDOG_H_
+
+struct pcibx_device;
+
+/* Watch the limits configured in cmdargs and cut the UUT power
+ * on the first violation. Returns -1, if the watchdog tripped. */
+int watchdog_run(struct pcibx_device *dev);
+
+#endif /* PCIBX_WATCHDOG_H_ */